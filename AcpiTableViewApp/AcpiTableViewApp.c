@@ -3,6 +3,7 @@
 #include <Library/UefiLib.h>
 #include <Library/ShellLib.h>
 #include <Library/AcpiViewCommandLib.h>
+#include <Library/AcpiTableParseLib.h>
 
 #include <Protocol/ShellParameters.h>
 
@@ -17,6 +18,7 @@ typedef UINT32 CHECKSUM_OFFSET;
 
 STATIC UINT32 mTableCount;
 STATIC UINT32 mBinTableCount;
+STATIC ACPI_TABLE_INDEX mAcpiIndex;
 
 BOOLEAN
 EFIAPI
@@ -98,21 +100,11 @@ EFIAPI
 ChangeTable(
   IN UINT8 *TablePtr
 ) {
-  UINTN oemidreadingoffset;
   char NewOemId[6] = "NEWID "; // New OEMID to set
-  UINT8 NewCheckSum = 0;
-  UINTN i;
 
-  for (oemidreadingoffset = 0; oemidreadingoffset < 6; oemidreadingoffset++)
-  {
-    *(TablePtr + 10 + oemidreadingoffset) = NewOemId[oemidreadingoffset];
-  }
-  for (i = 0; i < *(UINT32*)(TablePtr + 4); i++) {
-    if (i != 9) {
-      NewCheckSum += *(TablePtr + i);
-    }
-  }
-  *(TablePtr + 9) = 0 - NewCheckSum;
+  // Only the six OEMID bytes change, so the checksum is adjusted by their difference
+  // instead of summing the whole table again.
+  AcpiTablePatch(TablePtr, ACPI_TABLE_OEMID_OFFSET, NewOemId, ACPI_TABLE_OEMID_SIZE);
 }
 
 EFI_STATUS
@@ -121,7 +113,7 @@ PrintAllACPITables(
   IN EFI_HANDLE ImageHandle,
   IN EFI_SYSTEM_TABLE *SystemTable)
 {
-  EFI_STATUS Status;
+  RETURN_STATUS Status;
   SHELL_STATUS ShellStatus;
   UINTN Index;
   BOOLEAN FoundAcpiTable;
@@ -134,6 +126,7 @@ PrintAllACPITables(
 
   mTableCount = 0;
   mBinTableCount = 0;
+  ShellStatus = SHELL_SUCCESS;
 
   if (SystemTable == NULL) {
     ShellStatus = SHELL_INVALID_PARAMETER;
@@ -152,38 +145,53 @@ PrintAllACPITables(
     }
 
     if (FoundAcpiTable) {
-      RsdpRevision = *(RsdpPtr + 15);
+      RsdpRevision = *(RsdpPtr + ACPI_RSDP_REVISION_OFFSET);
 
       if (RsdpRevision < 2) {
         Print(L"ERROR: RSDP revision is less than 2.\n");
         return EFI_UNSUPPORTED;
       }
 
+      // One pass over the XSDT; every later lookup goes through the signature index.
+      // The status carries only one problem; the flags report every one of them.
+      Status = AcpiTableIndexBuild(&mAcpiIndex, RsdpPtr, NULL, NULL);
+      if (RETURN_ERROR(Status) && Status != RETURN_CRC_ERROR && Status != RETURN_BUFFER_TOO_SMALL) {
+        Print(L"ERROR: Failed to parse XSDT - %r\n", Status);
+        return Status;
+      }
+      if ((mAcpiIndex.Flags & ACPI_TABLE_INDEX_CRC_ERROR) != 0) {
+        Print(L"WARNING: RSDP or XSDT checksum is invalid.\n");
+      }
+      if ((mAcpiIndex.Flags & ACPI_TABLE_INDEX_OVERFLOW) != 0) {
+        Print(L"WARNING: %u ACPI tables beyond the first %u are neither printed nor patched.\n",
+              mAcpiIndex.Dropped, ACPI_TABLE_INDEX_MAX_TABLES);
+      }
+      if ((mAcpiIndex.Flags & ACPI_TABLE_INDEX_TRUNCATED) != 0) {
+        Print(L"WARNING: Some ACPI tables are truncated and are neither printed nor patched.\n");
+      }
+
       PrintTable("RSDP", RsdpPtr, 8, 4, 20, 6, 9, 1, 32); // RSDP Table
-      UINT8 *RsdtPtr = (UINT8 *)(UINTN)(*(UINT32 *)(RsdpPtr + 16));
+      UINT8 *RsdtPtr = (UINT8 *)(UINTN)(*(UINT32 *)(RsdpPtr + ACPI_RSDP_RSDT_OFFSET));
       PrintTable("RSDT", RsdtPtr, 4, 4, 4, 6, 10, 1, 9); // RSDT Table
-      UINT8 *XsdtPtr = (UINT8 *)(UINTN)(*(UINT64 *)(RsdpPtr + 24));
-      PrintTable("XSDT", XsdtPtr, 4, 4, 4, 6, 10, 1, 9); // XSDT Table
-      for (Index = 0; Index < (*(UINT32 *)(XsdtPtr + 4) - 36) / 8; Index++) {
-        UINT8 *UnKnownPtr = (UINT8 *)(UINTN)(*(UINT64 *)(XsdtPtr + 36 + Index * 8));
-        ChangeTable(UnKnownPtr);
-        PrintTable(NULL, UnKnownPtr, 4, 4, 4, 6, 10, 1, 9); // Unknown Table
+      PrintTable("XSDT", mAcpiIndex.Xsdt, 4, 4, 4, 6, 10, 1, 9); // XSDT Table
+      for (Index = 0; Index < mAcpiIndex.Count; Index++) {
+        ACPI_TABLE_INDEX_ENTRY *Entry = &mAcpiIndex.Entries[Index];
+        // DSDT and FACS are reached through the FADT, not listed in the XSDT
+        if (Entry->Signature == ACPI_SIG_XSDT || Entry->Signature == ACPI_SIG_DSDT ||
+            Entry->Signature == ACPI_SIG_FACS) {
+          continue;
+        }
+        ChangeTable(Entry->Table);
+        PrintTable(NULL, Entry->Table, 4, 4, 4, 6, 10, 1, 9); // Unknown Table
       }
-      UINT8 *FadtPtr = (UINT8 *)(UINTN)(*(UINT64 *)(XsdtPtr + 36));
-      // UINT8 *FacsPtr = (UINT8 *)(UINTN)(*(UINT32 *)(FadtPtr + 36));
-      UINT8 *DsdtPtr = (UINT8 *)(UINTN)(*(UINT32 *)(FadtPtr + 40));
-      // PrintTable("FACS", FacsPtr, 4, 4, 4, 6, 10, 1, 9); // FACS Table
-      PrintTable("DSDT", DsdtPtr, 4, 4, 4, 6, 10, 1, 9); // DSDT Table
+      // PrintTable("FACS", AcpiTableIndexFind(&mAcpiIndex, ACPI_SIG_FACS, 0), 4, 4, 4, 6, 10, 1, 9); // FACS Table
+      PrintTable("DSDT", AcpiTableIndexFind(&mAcpiIndex, ACPI_SIG_DSDT, 0), 4, 4, 4, 6, 10, 1, 9); // DSDT Table
     }
     else
     {
       Print(L"ERROR: Failed to find ACPI Table Guid in System Configuration Table.\n");
       return EFI_NOT_FOUND;
     }
-
-    if (EFI_ERROR(Status)) {
-      
-    }
   }
 
   return ShellStatus;
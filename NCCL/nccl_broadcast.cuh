@@ -22,6 +22,10 @@
 #include <nccl.h>
 #include <cuda_runtime.h>
 
+/*
+ * 一次性调用的版本，每次都创建流、分配显存，适合偶尔调用。
+ * 反复调用时用下面的 nccl_ctx，流和显存只分配一次，大数据还会分块流水。
+ */
 ncclResult_t nccl_broadcast_data(void* data, size_t count, int root, ncclComm_t comm) {
   cudaStream_t stream;
   CUDACHECK(cudaStreamCreate(&stream));
@@ -32,6 +36,7 @@ ncclResult_t nccl_broadcast_data(void* data, size_t count, int root, ncclComm_t
   NCCLCHECK(ncclBroadcast(d_ptr, d_ptr, count, ncclFloat, root, comm, stream));
   CUDACHECK(cudaStreamSynchronize(stream));
   CUDACHECK(cudaFree(d_ptr));
+  CUDACHECK(cudaStreamDestroy(stream));
   return ncclSuccess;
 }
 
@@ -41,7 +46,129 @@ ncclResult_t nccl_all_reduce(void* data, size_t count, ncclRedOp_t opt, ncclComm
 
   NCCLCHECK(ncclAllReduce(data, data, count, ncclFloat, opt, comm, stream));
   CUDACHECK(cudaStreamSynchronize(stream));
+  CUDACHECK(cudaStreamDestroy(stream));
   return ncclSuccess;
 }
 
+/*
+ * 持久的通信上下文：拥有三条流（拷入、通信、拷出）和 NCCL_CTX_SLOTS 块设备缓冲，
+ * 初始化后可以反复使用。主机上的数据按 chunk_count 个 float 分块，
+ * 第 i 块用第 i % NCCL_CTX_SLOTS 块缓冲，三条流之间用事件衔接：
+ *
+ *   h2d:  等槽空闲 -> 拷入第 i 块       （同时）
+ *   comm:            等拷入 -> 通信第 i-1 块
+ *   d2h:                          等通信 -> 拷出第 i-2 块 -> 槽空闲
+ *
+ * 拷贝和通信互相重叠。主机缓冲要是锁页内存（cudaMallocHost 或 cudaHostRegister），
+ * 否则 cudaMemcpyAsync 会退化成同步拷贝，流水不起作用。
+ * 同一个 communicator 上所有 rank 的 chunk_count 必须相同，分块后的集合调用才能一一对应。
+ */
+#define NCCL_CTX_SLOTS 4
+#define NCCL_CTX_DEFAULT_CHUNK ((size_t)1 << 20)  // 1M 个 float，即 4MB
+
+struct nccl_ctx {
+  ncclComm_t comm;
+  int rank;
+  size_t chunk_count;
+  cudaStream_t h2d;
+  cudaStream_t comm_stream;
+  cudaStream_t d2h;
+  cudaEvent_t copied_in[NCCL_CTX_SLOTS];
+  cudaEvent_t reduced[NCCL_CTX_SLOTS];
+  cudaEvent_t slot_free[NCCL_CTX_SLOTS];
+  float* slot[NCCL_CTX_SLOTS];
+};
+
+/* chunk_count 为 0 时使用 NCCL_CTX_DEFAULT_CHUNK */
+ncclResult_t nccl_ctx_init(struct nccl_ctx* ctx, ncclComm_t comm, size_t chunk_count) {
+  ctx->comm = comm;
+  ctx->chunk_count = chunk_count ? chunk_count : NCCL_CTX_DEFAULT_CHUNK;
+  NCCLCHECK(ncclCommUserRank(comm, &ctx->rank));
+  CUDACHECK(cudaStreamCreateWithFlags(&ctx->h2d, cudaStreamNonBlocking));
+  CUDACHECK(cudaStreamCreateWithFlags(&ctx->comm_stream, cudaStreamNonBlocking));
+  CUDACHECK(cudaStreamCreateWithFlags(&ctx->d2h, cudaStreamNonBlocking));
+  for (int i = 0; i < NCCL_CTX_SLOTS; i++) {
+    CUDACHECK(cudaEventCreateWithFlags(&ctx->copied_in[i], cudaEventDisableTiming));
+    CUDACHECK(cudaEventCreateWithFlags(&ctx->reduced[i], cudaEventDisableTiming));
+    CUDACHECK(cudaEventCreateWithFlags(&ctx->slot_free[i], cudaEventDisableTiming));
+    CUDACHECK(cudaMalloc((void **)&ctx->slot[i], ctx->chunk_count * sizeof(float)));
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t nccl_ctx_destroy(struct nccl_ctx* ctx) {
+  CUDACHECK(cudaStreamSynchronize(ctx->h2d));
+  CUDACHECK(cudaStreamSynchronize(ctx->comm_stream));
+  CUDACHECK(cudaStreamSynchronize(ctx->d2h));
+  for (int i = 0; i < NCCL_CTX_SLOTS; i++) {
+    CUDACHECK(cudaFree(ctx->slot[i]));
+    CUDACHECK(cudaEventDestroy(ctx->copied_in[i]));
+    CUDACHECK(cudaEventDestroy(ctx->reduced[i]));
+    CUDACHECK(cudaEventDestroy(ctx->slot_free[i]));
+  }
+  CUDACHECK(cudaStreamDestroy(ctx->h2d));
+  CUDACHECK(cudaStreamDestroy(ctx->comm_stream));
+  CUDACHECK(cudaStreamDestroy(ctx->d2h));
+  return ncclSuccess;
+}
+
+/* 等三条流都做完，返回后主机缓冲里是最终结果 */
+static ncclResult_t nccl_ctx_sync(struct nccl_ctx* ctx) {
+  CUDACHECK(cudaStreamSynchronize(ctx->h2d));
+  CUDACHECK(cudaStreamSynchronize(ctx->comm_stream));
+  CUDACHECK(cudaStreamSynchronize(ctx->d2h));
+  return ncclSuccess;
+}
+
+/*
+ * 广播主机上的 count 个 float，返回后每个 rank 的 data 都等于 root 的数据。
+ * root 只需要拷入，其他 rank 只需要拷出。
+ */
+ncclResult_t nccl_ctx_broadcast(struct nccl_ctx* ctx, void* data, size_t count, int root) {
+  float* host = (float*)data;
+
+  for (size_t off = 0, i = 0; off < count; off += ctx->chunk_count, i++) {
+    int s = (int)(i % NCCL_CTX_SLOTS);
+    size_t n = count - off < ctx->chunk_count ? count - off : ctx->chunk_count;
+
+    if (ctx->rank == root) {
+      CUDACHECK(cudaStreamWaitEvent(ctx->h2d, ctx->slot_free[s], 0));
+      CUDACHECK(cudaMemcpyAsync(ctx->slot[s], host + off, n * sizeof(float), cudaMemcpyHostToDevice, ctx->h2d));
+      CUDACHECK(cudaEventRecord(ctx->copied_in[s], ctx->h2d));
+      CUDACHECK(cudaStreamWaitEvent(ctx->comm_stream, ctx->copied_in[s], 0));
+      NCCLCHECK(ncclBroadcast(ctx->slot[s], ctx->slot[s], n, ncclFloat, root, ctx->comm, ctx->comm_stream));
+      CUDACHECK(cudaEventRecord(ctx->slot_free[s], ctx->comm_stream));
+    } else {
+      CUDACHECK(cudaStreamWaitEvent(ctx->comm_stream, ctx->slot_free[s], 0));
+      NCCLCHECK(ncclBroadcast(ctx->slot[s], ctx->slot[s], n, ncclFloat, root, ctx->comm, ctx->comm_stream));
+      CUDACHECK(cudaEventRecord(ctx->reduced[s], ctx->comm_stream));
+      CUDACHECK(cudaStreamWaitEvent(ctx->d2h, ctx->reduced[s], 0));
+      CUDACHECK(cudaMemcpyAsync(host + off, ctx->slot[s], n * sizeof(float), cudaMemcpyDeviceToHost, ctx->d2h));
+      CUDACHECK(cudaEventRecord(ctx->slot_free[s], ctx->d2h));
+    }
+  }
+  return nccl_ctx_sync(ctx);
+}
+
+/* 对主机上的 count 个 float 做 allreduce，结果原地写回 data */
+ncclResult_t nccl_ctx_all_reduce(struct nccl_ctx* ctx, void* data, size_t count, ncclRedOp_t opt) {
+  float* host = (float*)data;
+
+  for (size_t off = 0, i = 0; off < count; off += ctx->chunk_count, i++) {
+    int s = (int)(i % NCCL_CTX_SLOTS);
+    size_t n = count - off < ctx->chunk_count ? count - off : ctx->chunk_count;
+
+    CUDACHECK(cudaStreamWaitEvent(ctx->h2d, ctx->slot_free[s], 0));
+    CUDACHECK(cudaMemcpyAsync(ctx->slot[s], host + off, n * sizeof(float), cudaMemcpyHostToDevice, ctx->h2d));
+    CUDACHECK(cudaEventRecord(ctx->copied_in[s], ctx->h2d));
+    CUDACHECK(cudaStreamWaitEvent(ctx->comm_stream, ctx->copied_in[s], 0));
+    NCCLCHECK(ncclAllReduce(ctx->slot[s], ctx->slot[s], n, ncclFloat, opt, ctx->comm, ctx->comm_stream));
+    CUDACHECK(cudaEventRecord(ctx->reduced[s], ctx->comm_stream));
+    CUDACHECK(cudaStreamWaitEvent(ctx->d2h, ctx->reduced[s], 0));
+    CUDACHECK(cudaMemcpyAsync(host + off, ctx->slot[s], n * sizeof(float), cudaMemcpyDeviceToHost, ctx->d2h));
+    CUDACHECK(cudaEventRecord(ctx->slot_free[s], ctx->d2h));
+  }
+  return nccl_ctx_sync(ctx);
+}
+
 #endif // NCCL_BROADCAST_CUH
\ No newline at end of file
@@ -0,0 +1,419 @@
+#ifndef SHM_COLLECTIVES_H
+#define SHM_COLLECTIVES_H
+
+/*
+ * nccl_ctx 的 CPU 版本：同一台机器上的多个进程通过 POSIX 共享内存做环形 broadcast/allreduce，
+ * 接口与 nccl_broadcast.cuh 中的 nccl_ctx_* 对应，不依赖 CUDA，可以在没有 GPU 的机器上编译运行。
+ *
+ * 共享内存布局：
+ *   [shm_header][rank 0 的发件箱][rank 1 的发件箱]...
+ * 每个发件箱有 SHM_CTX_SLOTS 个槽，每槽 chunk_count 个 float。rank r 只往自己的发件箱写，
+ * 只从 rank r-1 的发件箱读，数据沿环 0 -> 1 -> ... -> n-1 -> 0 流动。
+ * 槽的 full 计数由写者递增，done 计数由读者递增，两者之差就是还没被读走的块数，
+ * 不超过槽数，所以写者最多领先读者 SHM_CTX_SLOTS 块，读写在块粒度上流水。
+ *
+ * 所有 rank 必须用相同的 name、nranks、chunk_count 初始化，并以相同顺序调用集合操作。
+ * name 在一次任务内唯一即可（例如带上任务 id），rank 0 创建、销毁时删除。
+ *
+ * 进程异常退出会留下同名的旧对象，其他 rank 可能在 rank 0 删除重建之前先打开它，
+ * 旧对象里的 magic 和计数器都不可信。所以初始化时做一次握手：
+ *   - rank 0 删除旧对象前先把它的 magic 改成 SHM_CTX_DEAD，已经映射了旧对象的 rank 看到后重新打开；
+ *   - 其他 rank 往自己的 join 槽写一个本次新生成的随机数，等 rank 0 在 ack 里原样写回。
+ *     只有 rank 0 新建的对象里才会有人回应，旧对象里残留的 ack 对不上这个随机数。
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_CTX_SLOTS 4
+#define SHM_CTX_DEFAULT_CHUNK ((size_t)16 << 10)  // 16K 个 float，即 64KB，能放进 L2
+#define SHM_CTX_MAGIC 0x53484d43u                 // "SHMC"
+#define SHM_CTX_DEAD 0x44454144u                  // "DEAD"，rank 0 删除旧对象前写入
+
+enum shm_red_op {
+  shm_sum,
+  shm_prod,
+  shm_max,
+  shm_min,
+};
+
+struct shm_header {
+  uint32_t magic;      // rank 0 初始化完成后写入 SHM_CTX_MAGIC，删除旧对象前写入 SHM_CTX_DEAD
+  uint32_t nranks;
+  uint64_t chunk_count;
+  uint32_t barrier_count;
+  uint32_t barrier_sense;
+};
+
+/* 握手用，紧跟在 shm_header 后面，每个 rank 一个 */
+struct shm_join {
+  uint64_t nonce;  // rank r 写入本次初始化生成的随机数，非 0
+  uint64_t ack;    // rank 0 确认后写回同一个值
+};
+
+/* 每个发件箱的计数器各占一个 cache line，避免读写两端互相抢 */
+struct shm_mailbox {
+  uint64_t full __attribute__((aligned(64)));  // 已写入的块数
+  uint64_t done __attribute__((aligned(64)));  // 已被下游读走的块数
+};
+
+struct shm_ctx {
+  int rank;
+  int nranks;
+  size_t chunk_count;
+  char name[64];
+  void* base;
+  size_t size;
+  struct shm_header* header;
+  uint32_t sense;
+  uint64_t sent;      // 本 rank 已写入发件箱的块数
+  uint64_t received;  // 本 rank 已从上游读走的块数
+};
+
+static inline size_t shm_header_size(int nranks) {
+  size_t size = sizeof(struct shm_header) + (size_t)nranks * sizeof(struct shm_join);
+
+  return (size + 63) & ~(size_t)63;
+}
+
+static inline struct shm_join* shm_join_of(struct shm_ctx* ctx, int rank) {
+  return (struct shm_join*)(ctx->header + 1) + rank;
+}
+
+static inline size_t shm_mailbox_size(size_t chunk_count) {
+  size_t size = sizeof(struct shm_mailbox) + SHM_CTX_SLOTS * chunk_count * sizeof(float);
+
+  return (size + 63) & ~(size_t)63;
+}
+
+static inline struct shm_mailbox* shm_mailbox_of(struct shm_ctx* ctx, int rank) {
+  return (struct shm_mailbox*)((char*)ctx->base + shm_header_size(ctx->nranks) +
+                               (size_t)rank * shm_mailbox_size(ctx->chunk_count));
+}
+
+static inline float* shm_slot_of(struct shm_mailbox* box, size_t chunk_count, uint64_t seq) {
+  return (float*)(box + 1) + (seq % SHM_CTX_SLOTS) * chunk_count;
+}
+
+/* 等 *p 达到 value。先忙等一会儿，等久了让出 CPU，进程数多于核数时也不会卡死 */
+static inline void shm_wait_at_least(const uint64_t* p, uint64_t value) {
+  for (unsigned spins = 0; __atomic_load_n(p, __ATOMIC_ACQUIRE) < value; spins++) {
+    if (spins < 1024) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+/* 集中式翻转屏障 */
+static inline void shm_barrier(struct shm_ctx* ctx) {
+  struct shm_header* h = ctx->header;
+
+  ctx->sense ^= 1;
+  if (__atomic_add_fetch(&h->barrier_count, 1, __ATOMIC_ACQ_REL) == (uint32_t)ctx->nranks) {
+    __atomic_store_n(&h->barrier_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->barrier_sense, ctx->sense, __ATOMIC_RELEASE);
+    return;
+  }
+  for (unsigned spins = 0; __atomic_load_n(&h->barrier_sense, __ATOMIC_ACQUIRE) != ctx->sense; spins++) {
+    if (spins >= 1024)
+      sched_yield();
+  }
+}
+
+/* rank 0 删除旧对象前调用：标记为作废，已经映射了它的 rank 会放弃并重新打开 */
+static inline void shm_mark_dead(const char* name) {
+  struct stat st;
+  void* p;
+  int fd = shm_open(name, O_RDWR, 0600);
+
+  if (fd == -1)
+    return;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct shm_header)) {
+    p = mmap(NULL, sizeof(struct shm_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      __atomic_store_n(&((struct shm_header*)p)->magic, SHM_CTX_DEAD, __ATOMIC_RELEASE);
+      munmap(p, sizeof(struct shm_header));
+    }
+  }
+  close(fd);
+}
+
+/* 握手用的随机数，pid 加纳秒时间，旧对象里残留的值不会与之相同；保证非 0 */
+static inline uint64_t shm_nonce(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (((uint64_t)getpid() << 32) ^ ((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec)) | 1;
+}
+
+/*
+ * 非 0 rank 用：打开 rank 0 建好的对象并完成握手。
+ * 映射到的是旧对象时（看到 SHM_CTX_DEAD）解除映射重新打开，直到 rank 0 回应为止。
+ */
+static int shm_ctx_join(struct shm_ctx* ctx) {
+  struct shm_join* join;
+  struct stat st;
+  uint64_t nonce;
+  int fd;
+
+  for (;;) {
+    // 等 rank 0 创建好并设定大小
+    fd = shm_open(ctx->name, O_RDWR, 0600);
+    if (fd == -1) {
+      if (errno != ENOENT)
+        return -1;
+      usleep(1000);
+      continue;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != ctx->size) {
+      close(fd);
+      usleep(1000);
+      continue;
+    }
+    ctx->base = mmap(NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ctx->base == MAP_FAILED) {
+      ctx->base = NULL;
+      return -1;
+    }
+    ctx->header = (struct shm_header*)ctx->base;
+    join = shm_join_of(ctx, ctx->rank);
+    nonce = shm_nonce();
+    __atomic_store_n(&join->nonce, nonce, __ATOMIC_RELEASE);
+    for (;;) {
+      if (__atomic_load_n(&join->ack, __ATOMIC_ACQUIRE) == nonce)
+        return 0;
+      if (__atomic_load_n(&ctx->header->magic, __ATOMIC_ACQUIRE) == SHM_CTX_DEAD)
+        break;
+      usleep(1000);
+    }
+    munmap(ctx->base, ctx->size);
+    ctx->base = NULL;
+    ctx->header = NULL;
+  }
+}
+
+/*
+ * 所有 rank 各自调用一次，返回时所有 rank 都已映射好 rank 0 本次新建的共享内存。
+ * chunk_count 为 0 时使用 SHM_CTX_DEFAULT_CHUNK。成功返回 0，失败返回 -1 并设置 errno。
+ */
+static int shm_ctx_init(struct shm_ctx* ctx, const char* name, int rank, int nranks, size_t chunk_count) {
+  int fd;
+
+  memset(ctx, 0, sizeof(*ctx));
+  if (nranks < 1 || rank < 0 || rank >= nranks || name[0] != '/' || strlen(name) >= sizeof(ctx->name)) {
+    errno = EINVAL;
+    return -1;
+  }
+  ctx->rank = rank;
+  ctx->nranks = nranks;
+  ctx->chunk_count = chunk_count ? chunk_count : SHM_CTX_DEFAULT_CHUNK;
+  strcpy(ctx->name, name);
+  ctx->size = shm_header_size(nranks) + (size_t)nranks * shm_mailbox_size(ctx->chunk_count);
+
+  if (rank != 0) {
+    if (shm_ctx_join(ctx) == -1)
+      return -1;
+    if (ctx->header->magic != SHM_CTX_MAGIC || ctx->header->nranks != (uint32_t)nranks ||
+        ctx->header->chunk_count != ctx->chunk_count) {
+      munmap(ctx->base, ctx->size);
+      ctx->base = NULL;
+      errno = EINVAL;
+      return -1;
+    }
+    shm_barrier(ctx);
+    return 0;
+  }
+
+  shm_mark_dead(name);
+  shm_unlink(name);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1)
+    return -1;
+  if (ftruncate(fd, (off_t)ctx->size) == -1) {
+    close(fd);
+    shm_unlink(name);
+    return -1;
+  }
+  ctx->base = mmap(NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ctx->base == MAP_FAILED) {
+    ctx->base = NULL;
+    shm_unlink(name);
+    return -1;
+  }
+  ctx->header = (struct shm_header*)ctx->base;
+
+  // 新建的共享内存全为 0，计数器不用再清。magic 先于 ack 写入，其他 rank 握手成功后就能看到参数
+  ctx->header->nranks = (uint32_t)nranks;
+  ctx->header->chunk_count = ctx->chunk_count;
+  __atomic_store_n(&ctx->header->magic, SHM_CTX_MAGIC, __ATOMIC_RELEASE);
+  for (int r = 1; r < nranks; r++) {
+    struct shm_join* join = shm_join_of(ctx, r);
+    uint64_t nonce;
+
+    while ((nonce = __atomic_load_n(&join->nonce, __ATOMIC_ACQUIRE)) == 0)
+      usleep(1000);
+    __atomic_store_n(&join->ack, nonce, __ATOMIC_RELEASE);
+  }
+  shm_barrier(ctx);
+  return 0;
+}
+
+static void shm_ctx_destroy(struct shm_ctx* ctx) {
+  if (ctx->base == NULL)
+    return;
+  shm_barrier(ctx);
+  munmap(ctx->base, ctx->size);
+  ctx->base = NULL;
+  if (ctx->rank == 0)
+    shm_unlink(ctx->name);
+}
+
+/* 拿到发件箱里下一个可写的槽，下游还没读走时等待 */
+static inline float* shm_send_begin(struct shm_ctx* ctx) {
+  struct shm_mailbox* box = shm_mailbox_of(ctx, ctx->rank);
+
+  if (ctx->sent >= SHM_CTX_SLOTS)
+    shm_wait_at_least(&box->done, ctx->sent - SHM_CTX_SLOTS + 1);
+  return shm_slot_of(box, ctx->chunk_count, ctx->sent);
+}
+
+static inline void shm_send_end(struct shm_ctx* ctx) {
+  __atomic_store_n(&shm_mailbox_of(ctx, ctx->rank)->full, ++ctx->sent, __ATOMIC_RELEASE);
+}
+
+/* 等上游的下一块到达，返回它所在的槽 */
+static inline const float* shm_recv_begin(struct shm_ctx* ctx) {
+  struct shm_mailbox* box = shm_mailbox_of(ctx, (ctx->rank + ctx->nranks - 1) % ctx->nranks);
+
+  shm_wait_at_least(&box->full, ctx->received + 1);
+  return shm_slot_of(box, ctx->chunk_count, ctx->received);
+}
+
+static inline void shm_recv_end(struct shm_ctx* ctx) {
+  struct shm_mailbox* box = shm_mailbox_of(ctx, (ctx->rank + ctx->nranks - 1) % ctx->nranks);
+
+  __atomic_store_n(&box->done, ++ctx->received, __ATOMIC_RELEASE);
+}
+
+static inline void shm_reduce(float* dst, const float* src, size_t n, enum shm_red_op op) {
+  size_t i;
+
+  switch (op) {
+  case shm_sum:
+    for (i = 0; i < n; i++)
+      dst[i] += src[i];
+    break;
+  case shm_prod:
+    for (i = 0; i < n; i++)
+      dst[i] *= src[i];
+    break;
+  case shm_max:
+    for (i = 0; i < n; i++)
+      dst[i] = dst[i] > src[i] ? dst[i] : src[i];
+    break;
+  case shm_min:
+    for (i = 0; i < n; i++)
+      dst[i] = dst[i] < src[i] ? dst[i] : src[i];
+    break;
+  }
+}
+
+/*
+ * 环形广播：root 把数据分块写进发件箱，每个 rank 收到一块就拷进自己的 data，
+ * 不是环上最后一个 rank 的话再原样转发。链上各段同时工作，耗时约为 (count + 链长 * 块) / 带宽。
+ */
+static int shm_ctx_broadcast(struct shm_ctx* ctx, void* data, size_t count, int root) {
+  float* buf = (float*)data;
+  int last = (root + ctx->nranks - 1) % ctx->nranks;
+
+  if (ctx->nranks == 1)
+    return 0;
+  for (size_t off = 0; off < count; off += ctx->chunk_count) {
+    size_t n = count - off < ctx->chunk_count ? count - off : ctx->chunk_count;
+
+    if (ctx->rank == root) {
+      memcpy(shm_send_begin(ctx), buf + off, n * sizeof(float));
+      shm_send_end(ctx);
+    } else {
+      const float* in = shm_recv_begin(ctx);
+
+      memcpy(buf + off, in, n * sizeof(float));
+      if (ctx->rank != last) {
+        memcpy(shm_send_begin(ctx), in, n * sizeof(float));
+        shm_send_end(ctx);
+      }
+      shm_recv_end(ctx);
+    }
+  }
+  return 0;
+}
+
+/* data 的第 seg 段（共 nranks 段，前 count % nranks 段各多一个元素） */
+static inline void shm_segment(const struct shm_ctx* ctx, size_t count, int seg, size_t* off, size_t* len) {
+  size_t base = count / (size_t)ctx->nranks, extra = count % (size_t)ctx->nranks;
+
+  *off = (size_t)seg * base + ((size_t)seg < extra ? (size_t)seg : extra);
+  *len = base + ((size_t)seg < extra ? 1 : 0);
+}
+
+/*
+ * 环形 allreduce：数据分成 nranks 段，先 reduce-scatter 走 nranks-1 步，
+ * 每步把一段发给下游、把上游发来的一段归约进本地，结束时每个 rank 持有一段的最终结果；
+ * 再 allgather 走 nranks-1 步把各段传遍整个环。每个 rank 收发的总量约为 2 * count，与 rank 数无关。
+ * 每段再按 chunk_count 分块，发送和接收在块粒度上交替进行。
+ */
+static int shm_ctx_all_reduce(struct shm_ctx* ctx, void* data, size_t count, enum shm_red_op op) {
+  float* buf = (float*)data;
+  int n = ctx->nranks;
+
+  if (n == 1)
+    return 0;
+  for (int step = 0; step < 2 * (n - 1); step++) {
+    int reduce = step < n - 1;
+    int k = reduce ? step : step - (n - 1);
+    // reduce-scatter 第 k 步发送第 r-k 段；allgather 第 k 步发送第 r+1-k 段（上一阶段结束时持有的那段）
+    int send_seg = ((ctx->rank - k + (reduce ? 0 : 1)) % n + n) % n;
+    int recv_seg = (send_seg + n - 1) % n;
+    size_t send_off, send_len, recv_off, recv_len;
+
+    shm_segment(ctx, count, send_seg, &send_off, &send_len);
+    shm_segment(ctx, count, recv_seg, &recv_off, &recv_len);
+
+    // 上游这一步发的正是 recv_seg，两边的分块数一致
+    for (size_t pos = 0; pos < send_len || pos < recv_len; pos += ctx->chunk_count) {
+      if (pos < send_len) {
+        size_t len = send_len - pos < ctx->chunk_count ? send_len - pos : ctx->chunk_count;
+
+        memcpy(shm_send_begin(ctx), buf + send_off + pos, len * sizeof(float));
+        shm_send_end(ctx);
+      }
+      if (pos < recv_len) {
+        size_t len = recv_len - pos < ctx->chunk_count ? recv_len - pos : ctx->chunk_count;
+        const float* in = shm_recv_begin(ctx);
+
+        if (reduce)
+          shm_reduce(buf + recv_off + pos, in, len, op);
+        else
+          memcpy(buf + recv_off + pos, in, len * sizeof(float));
+        shm_recv_end(ctx);
+      }
+    }
+  }
+  return 0;
+}
+
+#endif // SHM_COLLECTIVES_H
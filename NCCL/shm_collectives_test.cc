@@ -0,0 +1,149 @@
+/*
+ * shm_collectives.h 的正确性测试，不需要 GPU：
+ *   - 1~5 个进程，多种长度（含不足一块、正好一块、跨块、段长不均的情况），
+ *     反复做 broadcast 和 sum/max allreduce，核对每个 rank 的结果；
+ *   - 先放一个上次异常退出留下的旧对象（magic 有效、ack 是旧值），让非 0 rank 先于 rank 0 启动，
+ *     确认它们不会用上旧对象。
+ *
+ * 编译：g++ -O2 -o shm_collectives_test shm_collectives_test.cc
+ * 运行：./shm_collectives_test，全部通过返回 0
+ */
+
+#include "shm_collectives.h"
+#include <math.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define TEST_SHM_NAME "/shm_collectives_test"
+
+static int test_rank(int rank, int nranks, size_t count, size_t chunk_count) {
+  struct shm_ctx ctx;
+  float* data;
+  float sum = (float)nranks * (float)(nranks + 1) / 2;
+  int root = 1 % nranks;
+
+  if (shm_ctx_init(&ctx, TEST_SHM_NAME, rank, nranks, chunk_count) != 0) {
+    fprintf(stderr, "rank %d: shm_ctx_init: %s\n", rank, strerror(errno));
+    return 1;
+  }
+  data = (float*)malloc((count ? count : 1) * sizeof(float));
+  for (int it = 0; it < 3; it++) {
+    for (size_t i = 0; i < count; i++)
+      data[i] = rank == root ? (float)(i % 97 + it) : -1;
+    shm_ctx_broadcast(&ctx, data, count, root);
+    for (size_t i = 0; i < count; i++) {
+      if (data[i] != (float)(i % 97 + it)) {
+        fprintf(stderr, "rank %d: broadcast data[%zu] = %f\n", rank, i, data[i]);
+        return 1;
+      }
+    }
+
+    for (size_t i = 0; i < count; i++)
+      data[i] = (float)(rank + 1) * (float)(i % 7);
+    shm_ctx_all_reduce(&ctx, data, count, shm_sum);
+    for (size_t i = 0; i < count; i++) {
+      if (fabsf(data[i] - sum * (float)(i % 7)) > 1e-3f) {
+        fprintf(stderr, "rank %d: sum data[%zu] = %f\n", rank, i, data[i]);
+        return 1;
+      }
+    }
+
+    for (size_t i = 0; i < count; i++)
+      data[i] = (float)((rank + (int)i) % nranks);
+    shm_ctx_all_reduce(&ctx, data, count, shm_max);
+    for (size_t i = 0; i < count; i++) {
+      if (data[i] != (float)(nranks - 1)) {
+        fprintf(stderr, "rank %d: max data[%zu] = %f\n", rank, i, data[i]);
+        return 1;
+      }
+    }
+  }
+  free(data);
+  shm_ctx_destroy(&ctx);
+  return 0;
+}
+
+/* 每个 rank 一个子进程，rank0_delay_us 让 rank 0 晚启动；全部成功返回 0 */
+static int test_run(int nranks, size_t count, size_t chunk_count, useconds_t rank0_delay_us) {
+  int failed = 0, status;
+
+  for (int r = nranks - 1; r >= 0; r--) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      if (r == 0)
+        usleep(rank0_delay_us);
+      _exit(test_rank(r, nranks, count, chunk_count));
+    }
+    if (pid < 0)
+      return 1;
+  }
+  for (int r = 0; r < nranks; r++) {
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed = 1;
+  }
+  return failed;
+}
+
+/* 伪造一个异常退出留下的旧对象：大小与参数一致，magic 有效，每个 rank 的 ack 都等于 nonce */
+static int test_leave_stale(int nranks, size_t chunk_count) {
+  size_t size = shm_header_size(nranks) + (size_t)nranks * shm_mailbox_size(chunk_count);
+  struct shm_header* h;
+  struct shm_join* join;
+  int fd;
+
+  shm_unlink(TEST_SHM_NAME);
+  fd = shm_open(TEST_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1 || ftruncate(fd, (off_t)size) == -1)
+    return -1;
+  h = (struct shm_header*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (h == MAP_FAILED)
+    return -1;
+  h->magic = SHM_CTX_MAGIC;
+  h->nranks = (uint32_t)nranks;
+  h->chunk_count = chunk_count;
+  h->barrier_count = (uint32_t)nranks - 1;  // 用上旧对象的 rank 会卡在屏障里或者提前通过
+  join = (struct shm_join*)(h + 1);
+  for (int r = 0; r < nranks; r++) {
+    join[r].nonce = 12345;
+    join[r].ack = 12345;
+  }
+  munmap(h, size);
+  return 0;
+}
+
+int main(void) {
+  static const size_t counts[] = { 0, 1, 5, 999, 1000, 1001, 123457 };
+  const size_t chunk_count = 1000;
+  int failed = 0;
+
+  for (int n = 1; n <= 5; n++) {
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+      if (test_run(n, counts[i], chunk_count, 0) != 0) {
+        printf("FAIL nranks=%d count=%zu\n", n, counts[i]);
+        failed = 1;
+      }
+    }
+  }
+  if (test_run(3, 100000, 0, 0) != 0) {
+    printf("FAIL nranks=3 default chunk\n");
+    failed = 1;
+  }
+
+  // 非 0 rank 先启动并打开旧对象，rank 0 200ms 后才删除重建
+  for (int n = 2; n <= 4; n++) {
+    if (test_leave_stale(n, chunk_count) != 0) {
+      perror("stale object");
+      return 1;
+    }
+    if (test_run(n, 4321, chunk_count, 200000) != 0) {
+      printf("FAIL nranks=%d with a stale object\n", n);
+      failed = 1;
+    }
+  }
+
+  shm_unlink(TEST_SHM_NAME);
+  printf("%s\n", failed ? "FAILED" : "all passed");
+  return failed;
+}
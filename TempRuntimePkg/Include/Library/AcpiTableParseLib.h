@@ -0,0 +1,246 @@
+/** @file
+  ACPI 表解析库：一次遍历 XSDT 建立签名索引，按签名 O(1) 查表，按字长计算校验和。
+
+  库本身只依赖下面几个基本类型和 ReadUnaligned32/64，在 EDK2 里作为 BASE 库使用；
+  定义 ACPI_TABLE_PARSE_HOST 后可以直接用 Linux 上的 gcc/clang 编译，
+  用来处理 /sys/firmware/acpi/tables 下导出的表或者手工构造的表。
+
+  表里的地址都是物理地址。UEFI 下物理地址和指针恒等映射，Map 回调传 NULL 即可；
+  主机上解析导出的表时，由 Map 回调把物理地址换成内存中的副本，并给出副本的长度。
+  表头里的 Length 超出映射长度的表（例如截断的导出文件）不会加入索引，
+  索引里的表整张都可以安全访问。
+**/
+
+#ifndef _ACPI_TABLE_PARSE_LIB_H_
+#define _ACPI_TABLE_PARSE_LIB_H_
+
+#ifdef ACPI_TABLE_PARSE_HOST
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t   UINT8;
+typedef uint16_t  UINT16;
+typedef uint32_t  UINT32;
+typedef uint64_t  UINT64;
+typedef uintptr_t UINTN;
+typedef UINT8     BOOLEAN;
+typedef UINTN     RETURN_STATUS;
+
+#define VOID    void
+#define CONST   const
+#define STATIC  static
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+#define TRUE   ((BOOLEAN)1)
+#define FALSE  ((BOOLEAN)0)
+
+#define RETURN_SUCCESS            0
+#define RETURN_INVALID_PARAMETER  2
+#define RETURN_UNSUPPORTED        3
+#define RETURN_BUFFER_TOO_SMALL   5
+#define RETURN_NOT_FOUND          14
+#define RETURN_CRC_ERROR          27
+#define RETURN_ERROR(StatusCode)  ((StatusCode) != RETURN_SUCCESS)
+
+#define MAX_UINT32  ((UINT32)0xFFFFFFFF)
+#define MAX_UINTN   ((UINTN)-1)
+
+#define SIGNATURE_32(A, B, C, D) \
+  ((UINT32)(A) | ((UINT32)(B) << 8) | ((UINT32)(C) << 16) | ((UINT32)(D) << 24))
+
+static inline UINT32 ReadUnaligned32 (CONST UINT32 *Buffer) { UINT32 V; memcpy (&V, Buffer, sizeof (V)); return V; }
+static inline UINT64 ReadUnaligned64 (CONST UINT64 *Buffer) { UINT64 V; memcpy (&V, Buffer, sizeof (V)); return V; }
+#else
+#include <Base.h>
+#include <Library/BaseLib.h>
+#endif
+
+//
+// 标准描述表头（EFI_ACPI_DESCRIPTION_HEADER）中用到的字段偏移
+//
+#define ACPI_TABLE_HEADER_SIZE        36
+#define ACPI_TABLE_LENGTH_OFFSET      4
+#define ACPI_TABLE_CHECKSUM_OFFSET    9
+#define ACPI_TABLE_OEMID_OFFSET       10
+#define ACPI_TABLE_OEMID_SIZE         6
+
+//
+// RSDP 的字段偏移，ACPI 2.0 之后的 RSDP 共 36 字节，前 20 字节有单独的校验和
+//
+#define ACPI_RSDP_V1_SIZE             20
+#define ACPI_RSDP_V2_SIZE             36
+#define ACPI_RSDP_REVISION_OFFSET     15
+#define ACPI_RSDP_RSDT_OFFSET         16
+#define ACPI_RSDP_LENGTH_OFFSET       20
+#define ACPI_RSDP_XSDT_OFFSET         24
+
+//
+// FADT 中 FACS/DSDT 的地址，64 位字段只有表足够长时才存在
+//
+#define ACPI_FADT_FACS_OFFSET         36
+#define ACPI_FADT_DSDT_OFFSET         40
+#define ACPI_FADT_X_FACS_OFFSET       132
+#define ACPI_FADT_X_DSDT_OFFSET       140
+
+#define ACPI_SIG_XSDT  SIGNATURE_32 ('X', 'S', 'D', 'T')
+#define ACPI_SIG_FADT  SIGNATURE_32 ('F', 'A', 'C', 'P')
+#define ACPI_SIG_DSDT  SIGNATURE_32 ('D', 'S', 'D', 'T')
+#define ACPI_SIG_FACS  SIGNATURE_32 ('F', 'A', 'C', 'S')
+
+#define ACPI_TABLE_INDEX_MAX_TABLES   256
+#define ACPI_TABLE_INDEX_BUCKETS      64   // 2 的幂
+
+//
+// ACPI_TABLE_INDEX.Flags：建立索引时遇到的问题，可能同时有多个
+//
+#define ACPI_TABLE_INDEX_CRC_ERROR    0x00000001U  // RSDP 或 XSDT 的校验和错误
+#define ACPI_TABLE_INDEX_OVERFLOW     0x00000002U  // 表太多，Dropped 张没有加入索引
+#define ACPI_TABLE_INDEX_TRUNCATED    0x00000004U  // 有表的 Length 超出映射长度，没有加入索引
+
+/**
+  把表里的物理地址转换成可以访问的指针，找不到返回 NULL。
+  找到时 MappedLength 返回从该指针起可以访问的字节数，库不会读到这个范围之外。
+**/
+typedef
+VOID *
+(EFIAPI *ACPI_TABLE_MAP)(
+  IN  VOID    *Context,
+  IN  UINT64  Address,
+  OUT UINTN   *MappedLength
+  );
+
+typedef struct {
+  UINT32  Signature;
+  UINT32  Next;         // 同一桶里下一项的下标 + 1，0 表示结束
+  UINT8   *Table;
+} ACPI_TABLE_INDEX_ENTRY;
+
+//
+// 签名到表的索引。按签名散列到桶里，同签名的多张表（例如 SSDT）按 XSDT 中的顺序串在一起。
+// 结构体不含指向自身的指针，可以直接放在栈上或全局变量里。
+//
+typedef struct {
+  UINT8                   *Rsdp;
+  UINT8                   *Xsdt;        // 带 ACPI_TABLE_INDEX_TRUNCATED 时可能只映射了一部分
+  UINT32                  Count;
+  UINT32                  Flags;        // ACPI_TABLE_INDEX_*
+  UINT32                  Dropped;      // 索引已满后没能加入的表数
+  UINT32                  Bucket[ACPI_TABLE_INDEX_BUCKETS];  // 链头下标 + 1，0 表示空
+  UINT32                  Tail[ACPI_TABLE_INDEX_BUCKETS];    // 链尾下标 + 1，追加时保持原顺序
+  ACPI_TABLE_INDEX_ENTRY  Entries[ACPI_TABLE_INDEX_MAX_TABLES];
+} ACPI_TABLE_INDEX;
+
+/**
+  计算 Buffer 中所有字节之和（模 256），每次处理一个 64 位字。
+**/
+UINT8
+EFIAPI
+AcpiTableSum8 (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  );
+
+/**
+  返回让 Buffer 字节和为 0 的校验字节，与逐字节计算的结果相同。
+**/
+UINT8
+EFIAPI
+AcpiTableCalculateChecksum8 (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  );
+
+/**
+  按表头中的 Length 检查整张表的校验和。FACS 没有校验字节，不能用它检查。
+**/
+BOOLEAN
+EFIAPI
+AcpiTableVerifyChecksum (
+  IN CONST UINT8  *Table
+  );
+
+/**
+  重新计算整张表的校验字节并写回。
+**/
+VOID
+EFIAPI
+AcpiTableUpdateChecksum (
+  IN OUT UINT8  *Table
+  );
+
+/**
+  修改表中 Offset 起的 Size 个字节，按新旧字节之差增量更新校验字节，不用扫描整张表。
+  要求修改前表的校验和是正确的，修改后也保持正确。
+**/
+VOID
+EFIAPI
+AcpiTablePatch (
+  IN OUT UINT8       *Table,
+  IN     UINTN       Offset,
+  IN     CONST VOID  *Data,
+  IN     UINTN       Size
+  );
+
+/**
+  清空索引，之后可以用 AcpiTableIndexAdd 逐张加入表。
+**/
+VOID
+EFIAPI
+AcpiTableIndexInit (
+  OUT ACPI_TABLE_INDEX  *Index
+  );
+
+/**
+  把一张表加入索引。加入 FADT 时同时加入它引用的 DSDT 和 FACS（两者不在 XSDT 里）。
+  MappedLength 是从 Table 起可以访问的字节数，不知道时传 MAX_UINTN。
+
+  @retval RETURN_SUCCESS            已加入。
+  @retval RETURN_INVALID_PARAMETER  Table 为 NULL，或者表头里的 Length 超出 MappedLength。
+  @retval RETURN_BUFFER_TOO_SMALL   索引已满。
+**/
+RETURN_STATUS
+EFIAPI
+AcpiTableIndexAdd (
+  IN OUT ACPI_TABLE_INDEX  *Index,
+  IN     UINT8             *Table,
+  IN     UINTN             MappedLength,
+  IN     ACPI_TABLE_MAP    Map      OPTIONAL,
+  IN     VOID              *Context OPTIONAL
+  );
+
+/**
+  从 RSDP 出发遍历一次 XSDT，建立索引。只支持修订版本 2 及以上的 RSDP。
+  Rsdp 只需要有 ACPI_RSDP_V2_SIZE 字节可读：扩展校验和与 ACPICA 一样按固定的 36 字节计算，
+  不按 RSDP 自己的 Length 字段去读。
+  返回值只能反映一个问题，校验和错误、表太多、表被截断可能同时出现，完整情况看 Index->Flags。
+
+  @retval RETURN_SUCCESS            成功，Flags 里仍可能有 ACPI_TABLE_INDEX_TRUNCATED。
+  @retval RETURN_INVALID_PARAMETER  RSDP 签名不对，或者 Length 字段小于 ACPI_RSDP_V2_SIZE。
+  @retval RETURN_UNSUPPORTED        RSDP 修订版本低于 2，没有 XSDT。
+  @retval RETURN_NOT_FOUND          XSDT 地址无法映射、签名不对或者映射长度放不下表头。
+  @retval RETURN_CRC_ERROR          RSDP 或 XSDT 的校验和错误，索引仍然建立。
+  @retval RETURN_BUFFER_TOO_SMALL   表的数量超过 ACPI_TABLE_INDEX_MAX_TABLES，多出的被忽略。
+**/
+RETURN_STATUS
+EFIAPI
+AcpiTableIndexBuild (
+  OUT ACPI_TABLE_INDEX  *Index,
+  IN  UINT8             *Rsdp,
+  IN  ACPI_TABLE_MAP    Map      OPTIONAL,
+  IN  VOID              *Context OPTIONAL
+  );
+
+/**
+  查找签名为 Signature 的第 Instance 张表（从 0 开始），找不到返回 NULL。
+**/
+UINT8 *
+EFIAPI
+AcpiTableIndexFind (
+  IN CONST ACPI_TABLE_INDEX  *Index,
+  IN UINT32                  Signature,
+  IN UINTN                   Instance
+  );
+
+#endif
@@ -0,0 +1,481 @@
+// TempRuntimePkg/Library/AcpiTableParseLib/AcpiTableParseLib.c
+#include <Library/AcpiTableParseLib.h>
+
+//
+// 字节和按 64 位字累加：把一个字拆成奇偶两组字节，各放进 4 个 16 位通道里相加。
+// 每个字给每个通道最多加 2 * 255，累加 128 个字后通道还不会溢出，这时把 4 个通道加起来。
+//
+#define SUM8_LANE_MASK      0x00FF00FF00FF00FFULL
+#define SUM8_PAIR_MASK      0x0000FFFF0000FFFFULL
+#define SUM8_WORDS_PER_FOLD 128
+
+STATIC
+UINT32
+ReadTableLength (
+  IN CONST UINT8  *Table
+  )
+{
+  return ReadUnaligned32 ((CONST UINT32 *)(Table + ACPI_TABLE_LENGTH_OFFSET));
+}
+
+STATIC
+UINT32
+ReadTableSignature (
+  IN CONST UINT8  *Table
+  )
+{
+  return ReadUnaligned32 ((CONST UINT32 *)Table);
+}
+
+//
+// 表头里的 Length 字段不在映射范围内，或者 Length 超出映射范围时返回 0，调用者按表不可用处理
+//
+STATIC
+UINT32
+ReadMappedTableLength (
+  IN CONST UINT8  *Table,
+  IN UINTN        MappedLength
+  )
+{
+  UINT32  Length;
+
+  if (MappedLength < ACPI_TABLE_LENGTH_OFFSET + sizeof (UINT32)) {
+    return 0;
+  }
+  Length = ReadTableLength (Table);
+  return Length <= MappedLength ? Length : 0;
+}
+
+//
+// 恒等映射（Map 为 NULL）时不知道可访问的长度，按表头里的 Length 可信处理
+//
+STATIC
+UINT8 *
+MapAddress (
+  IN  ACPI_TABLE_MAP  Map      OPTIONAL,
+  IN  VOID            *Context OPTIONAL,
+  IN  UINT64          Address,
+  OUT UINTN           *MappedLength
+  )
+{
+  UINT8  *Pointer;
+
+  *MappedLength = 0;
+  if (Address == 0) {
+    return NULL;
+  }
+  if (Map == NULL) {
+    *MappedLength = MAX_UINTN;
+    return (UINT8 *)(UINTN)Address;
+  }
+  Pointer = (UINT8 *)Map (Context, Address, MappedLength);
+  if (Pointer == NULL) {
+    *MappedLength = 0;
+  }
+  return Pointer;
+}
+
+STATIC
+UINT32
+SignatureBucket (
+  IN UINT32  Signature
+  )
+{
+  return ((Signature * 0x9E3779B1U) >> 16) & (ACPI_TABLE_INDEX_BUCKETS - 1);
+}
+
+UINT8
+EFIAPI
+AcpiTableSum8 (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  CONST UINT8   *Bytes;
+  CONST UINT64  *Words;
+  UINTN         WordCount;
+  UINTN         Batch;
+  UINT64        Lanes;
+  UINT64        Word;
+  UINT32        Sum;
+
+  Bytes = (CONST UINT8 *)Buffer;
+  Sum   = 0;
+
+  //
+  // 1. 逐字节处理到 8 字节对齐
+  //
+  while (Length > 0 && ((UINTN)Bytes & 7) != 0) {
+    Sum += *Bytes++;
+    Length--;
+  }
+
+  //
+  // 2. 中间部分按字累加。地址已经对齐，用 ReadUnaligned64 只是为了宿主机编译时
+  //    经 memcpy 读取，避免透过 UINT64 指针访问字节数组违反严格别名规则
+  //
+  Words     = (CONST UINT64 *)Bytes;
+  WordCount = Length / 8;
+  while (WordCount > 0) {
+    Batch      = WordCount < SUM8_WORDS_PER_FOLD ? WordCount : SUM8_WORDS_PER_FOLD;
+    WordCount -= Batch;
+    Lanes      = 0;
+    while (Batch-- > 0) {
+      Word   = ReadUnaligned64 (Words++);
+      Lanes += (Word & SUM8_LANE_MASK) + ((Word >> 8) & SUM8_LANE_MASK);
+    }
+    //
+    // 4 个 16 位通道两两相加成 2 个 32 位通道，再加到一起
+    //
+    Lanes = (Lanes & SUM8_PAIR_MASK) + ((Lanes >> 16) & SUM8_PAIR_MASK);
+    Sum  += (UINT32)Lanes + (UINT32)(Lanes >> 32);
+  }
+
+  //
+  // 3. 剩余不足一个字的字节
+  //
+  Bytes   = (CONST UINT8 *)Words;
+  Length &= 7;
+  while (Length-- > 0) {
+    Sum += *Bytes++;
+  }
+
+  return (UINT8)Sum;
+}
+
+UINT8
+EFIAPI
+AcpiTableCalculateChecksum8 (
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  return (UINT8)(0 - AcpiTableSum8 (Buffer, Length));
+}
+
+BOOLEAN
+EFIAPI
+AcpiTableVerifyChecksum (
+  IN CONST UINT8  *Table
+  )
+{
+  if (Table == NULL) {
+    return FALSE;
+  }
+  return (BOOLEAN)(AcpiTableSum8 (Table, ReadTableLength (Table)) == 0);
+}
+
+VOID
+EFIAPI
+AcpiTableUpdateChecksum (
+  IN OUT UINT8  *Table
+  )
+{
+  Table[ACPI_TABLE_CHECKSUM_OFFSET] = 0;
+  Table[ACPI_TABLE_CHECKSUM_OFFSET] = AcpiTableCalculateChecksum8 (Table, ReadTableLength (Table));
+}
+
+VOID
+EFIAPI
+AcpiTablePatch (
+  IN OUT UINT8       *Table,
+  IN     UINTN       Offset,
+  IN     CONST VOID  *Data,
+  IN     UINTN       Size
+  )
+{
+  CONST UINT8  *NewBytes;
+  UINT8        Delta;
+  UINTN        Index;
+
+  NewBytes = (CONST UINT8 *)Data;
+
+  //
+  // 改动覆盖了校验字节本身时没法增量计算，改完整表重算
+  //
+  if (Offset <= ACPI_TABLE_CHECKSUM_OFFSET && Offset + Size > ACPI_TABLE_CHECKSUM_OFFSET) {
+    for (Index = 0; Index < Size; Index++) {
+      Table[Offset + Index] = NewBytes[Index];
+    }
+    AcpiTableUpdateChecksum (Table);
+    return;
+  }
+
+  //
+  // 校验字节 = -(其余字节之和)，其余字节之和变了多少，校验字节就反向变多少
+  //
+  Delta = 0;
+  for (Index = 0; Index < Size; Index++) {
+    Delta = (UINT8)(Delta + Table[Offset + Index] - NewBytes[Index]);
+    Table[Offset + Index] = NewBytes[Index];
+  }
+  Table[ACPI_TABLE_CHECKSUM_OFFSET] = (UINT8)(Table[ACPI_TABLE_CHECKSUM_OFFSET] + Delta);
+}
+
+VOID
+EFIAPI
+AcpiTableIndexInit (
+  OUT ACPI_TABLE_INDEX  *Index
+  )
+{
+  UINTN  Bucket;
+
+  Index->Rsdp    = NULL;
+  Index->Xsdt    = NULL;
+  Index->Count   = 0;
+  Index->Flags   = 0;
+  Index->Dropped = 0;
+  for (Bucket = 0; Bucket < ACPI_TABLE_INDEX_BUCKETS; Bucket++) {
+    Index->Bucket[Bucket] = 0;
+    Index->Tail[Bucket]   = 0;
+  }
+}
+
+//
+// 把一张表挂到对应桶的链尾；同一张表（同一地址）已经在索引里时直接返回
+//
+STATIC
+RETURN_STATUS
+IndexInsert (
+  IN OUT ACPI_TABLE_INDEX  *Index,
+  IN     UINT8             *Table
+  )
+{
+  ACPI_TABLE_INDEX_ENTRY  *Entry;
+  UINT32                  Signature;
+  UINT32                  Bucket;
+  UINT32                  Cursor;
+
+  Signature = ReadTableSignature (Table);
+  Bucket    = SignatureBucket (Signature);
+
+  for (Cursor = Index->Bucket[Bucket]; Cursor != 0; Cursor = Index->Entries[Cursor - 1].Next) {
+    if (Index->Entries[Cursor - 1].Table == Table) {
+      return RETURN_SUCCESS;
+    }
+  }
+
+  if (Index->Count >= ACPI_TABLE_INDEX_MAX_TABLES) {
+    Index->Flags |= ACPI_TABLE_INDEX_OVERFLOW;
+    Index->Dropped++;
+    return RETURN_BUFFER_TOO_SMALL;
+  }
+
+  Entry            = &Index->Entries[Index->Count++];
+  Entry->Signature = Signature;
+  Entry->Next      = 0;
+  Entry->Table     = Table;
+
+  if (Index->Tail[Bucket] == 0) {
+    Index->Bucket[Bucket] = Index->Count;
+  } else {
+    Index->Entries[Index->Tail[Bucket] - 1].Next = Index->Count;
+  }
+  Index->Tail[Bucket] = Index->Count;
+  return RETURN_SUCCESS;
+}
+
+//
+// 按 FADT 里的地址取 DSDT 或 FACS，签名对得上并且整张表都在映射范围内才加入索引。
+// 64 位地址优先，为 0 或表太短时用 32 位地址。
+//
+STATIC
+RETURN_STATUS
+IndexAddReferenced (
+  IN OUT ACPI_TABLE_INDEX  *Index,
+  IN     CONST UINT8       *Fadt,
+  IN     UINT32            FadtLength,
+  IN     UINTN             Offset32,
+  IN     UINTN             Offset64,
+  IN     UINT32            Signature,
+  IN     UINT32            MinLength,
+  IN     ACPI_TABLE_MAP    Map      OPTIONAL,
+  IN     VOID              *Context OPTIONAL
+  )
+{
+  UINT64  Address;
+  UINT8   *Referenced;
+  UINTN   MappedLength;
+  UINT32  Length;
+
+  Address = 0;
+  if (FadtLength >= Offset64 + 8) {
+    Address = ReadUnaligned64 ((CONST UINT64 *)(Fadt + Offset64));
+  }
+  if (Address == 0 && FadtLength >= Offset32 + 4) {
+    Address = ReadUnaligned32 ((CONST UINT32 *)(Fadt + Offset32));
+  }
+  Referenced = MapAddress (Map, Context, Address, &MappedLength);
+  if (Referenced == NULL || MappedLength < sizeof (UINT32) || ReadTableSignature (Referenced) != Signature) {
+    return RETURN_SUCCESS;
+  }
+  Length = ReadMappedTableLength (Referenced, MappedLength);
+  if (Length < MinLength) {
+    Index->Flags |= ACPI_TABLE_INDEX_TRUNCATED;
+    return RETURN_SUCCESS;
+  }
+  return IndexInsert (Index, Referenced);
+}
+
+RETURN_STATUS
+EFIAPI
+AcpiTableIndexAdd (
+  IN OUT ACPI_TABLE_INDEX  *Index,
+  IN     UINT8             *Table,
+  IN     UINTN             MappedLength,
+  IN     ACPI_TABLE_MAP    Map      OPTIONAL,
+  IN     VOID              *Context OPTIONAL
+  )
+{
+  RETURN_STATUS  Status;
+  UINT32         Length;
+
+  if (Table == NULL) {
+    return RETURN_INVALID_PARAMETER;
+  }
+  Length = ReadMappedTableLength (Table, MappedLength);
+  if (Length < ACPI_TABLE_HEADER_SIZE) {
+    Index->Flags |= ACPI_TABLE_INDEX_TRUNCATED;
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  Status = IndexInsert (Index, Table);
+  if (RETURN_ERROR (Status) || ReadTableSignature (Table) != ACPI_SIG_FADT) {
+    return Status;
+  }
+
+  //
+  // FACS 只有签名和 Length，没有标准表头
+  //
+  Status = IndexAddReferenced (
+             Index, Table, Length, ACPI_FADT_DSDT_OFFSET, ACPI_FADT_X_DSDT_OFFSET,
+             ACPI_SIG_DSDT, ACPI_TABLE_HEADER_SIZE, Map, Context
+             );
+  if (RETURN_ERROR (Status)) {
+    return Status;
+  }
+  return IndexAddReferenced (
+           Index, Table, Length, ACPI_FADT_FACS_OFFSET, ACPI_FADT_X_FACS_OFFSET,
+           ACPI_SIG_FACS, ACPI_TABLE_LENGTH_OFFSET + sizeof (UINT32), Map, Context
+           );
+}
+
+RETURN_STATUS
+EFIAPI
+AcpiTableIndexBuild (
+  OUT ACPI_TABLE_INDEX  *Index,
+  IN  UINT8             *Rsdp,
+  IN  ACPI_TABLE_MAP    Map      OPTIONAL,
+  IN  VOID              *Context OPTIONAL
+  )
+{
+  STATIC CONST UINT8  RsdpSignature[8] = { 'R', 'S', 'D', ' ', 'P', 'T', 'R', ' ' };
+  UINT8               *Xsdt;
+  UINT8               *Table;
+  UINTN               XsdtMapped;
+  UINTN               TableMapped;
+  UINT32              Length;
+  UINTN               EntryCount;
+  UINTN               Entry;
+
+  AcpiTableIndexInit (Index);
+
+  if (Rsdp == NULL) {
+    return RETURN_INVALID_PARAMETER;
+  }
+  for (Entry = 0; Entry < sizeof (RsdpSignature); Entry++) {
+    if (Rsdp[Entry] != RsdpSignature[Entry]) {
+      return RETURN_INVALID_PARAMETER;
+    }
+  }
+  if (Rsdp[ACPI_RSDP_REVISION_OFFSET] < 2) {
+    return RETURN_UNSUPPORTED;
+  }
+
+  //
+  // Length 放不下 XSDT 地址说明 RSDP 已经损坏；更大的值也不采信，
+  // 扩展校验和只覆盖修订版本 2 定义的 36 字节，不会读到调用者给的范围之外
+  //
+  Length = ReadUnaligned32 ((CONST UINT32 *)(Rsdp + ACPI_RSDP_LENGTH_OFFSET));
+  if (Length < ACPI_RSDP_V2_SIZE) {
+    return RETURN_INVALID_PARAMETER;
+  }
+  Index->Rsdp = Rsdp;
+
+  if (AcpiTableSum8 (Rsdp, ACPI_RSDP_V1_SIZE) != 0 || AcpiTableSum8 (Rsdp, ACPI_RSDP_V2_SIZE) != 0) {
+    Index->Flags |= ACPI_TABLE_INDEX_CRC_ERROR;
+  }
+
+  Xsdt = MapAddress (
+           Map,
+           Context,
+           ReadUnaligned64 ((CONST UINT64 *)(Rsdp + ACPI_RSDP_XSDT_OFFSET)),
+           &XsdtMapped
+           );
+  if (Xsdt == NULL || XsdtMapped < ACPI_TABLE_HEADER_SIZE || ReadTableSignature (Xsdt) != ACPI_SIG_XSDT) {
+    return RETURN_NOT_FOUND;
+  }
+  Index->Xsdt = Xsdt;
+
+  //
+  // XSDT 被截断时只遍历映射范围内的表项，校验和没法算，XSDT 本身也不进索引，
+  // 保证索引里的表都能按 Length 整张访问
+  //
+  Length = ReadMappedTableLength (Xsdt, XsdtMapped);
+  if (Length == 0) {
+    Index->Flags |= ACPI_TABLE_INDEX_TRUNCATED;
+    Length = XsdtMapped > MAX_UINT32 ? MAX_UINT32 : (UINT32)XsdtMapped;
+  } else {
+    if (!AcpiTableVerifyChecksum (Xsdt)) {
+      Index->Flags |= ACPI_TABLE_INDEX_CRC_ERROR;
+    }
+    IndexInsert (Index, Xsdt);
+  }
+
+  //
+  // XSDT 表头之后是 64 位地址数组，起始偏移 36 不是 8 字节对齐的。
+  // 索引满了也接着走完，Dropped 记下一共丢了多少张
+  //
+  EntryCount = Length > ACPI_TABLE_HEADER_SIZE ? (Length - ACPI_TABLE_HEADER_SIZE) / 8 : 0;
+  for (Entry = 0; Entry < EntryCount; Entry++) {
+    Table = MapAddress (
+              Map,
+              Context,
+              ReadUnaligned64 ((CONST UINT64 *)(Xsdt + ACPI_TABLE_HEADER_SIZE + Entry * 8)),
+              &TableMapped
+              );
+    if (Table == NULL) {
+      continue;
+    }
+    AcpiTableIndexAdd (Index, Table, TableMapped, Map, Context);
+  }
+
+  if ((Index->Flags & ACPI_TABLE_INDEX_CRC_ERROR) != 0) {
+    return RETURN_CRC_ERROR;
+  }
+  if ((Index->Flags & ACPI_TABLE_INDEX_OVERFLOW) != 0) {
+    return RETURN_BUFFER_TOO_SMALL;
+  }
+  return RETURN_SUCCESS;
+}
+
+UINT8 *
+EFIAPI
+AcpiTableIndexFind (
+  IN CONST ACPI_TABLE_INDEX  *Index,
+  IN UINT32                  Signature,
+  IN UINTN                   Instance
+  )
+{
+  UINT32  Cursor;
+
+  for (Cursor = Index->Bucket[SignatureBucket (Signature)]; Cursor != 0; Cursor = Index->Entries[Cursor - 1].Next) {
+    if (Index->Entries[Cursor - 1].Signature == Signature) {
+      if (Instance == 0) {
+        return Index->Entries[Cursor - 1].Table;
+      }
+      Instance--;
+    }
+  }
+  return NULL;
+}
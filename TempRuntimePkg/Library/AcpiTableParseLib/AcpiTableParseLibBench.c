@@ -0,0 +1,404 @@
+/** @file
+  AcpiTableParseLib 的主机基准，在 Linux 上直接编译运行：
+
+    gcc -O2 -DACPI_TABLE_PARSE_HOST -I../../Include AcpiTableParseLibBench.c AcpiTableParseLib.c \
+        -o AcpiTableParseLibBench
+    ./AcpiTableParseLibBench [-n 轮数] [-s | 表目录]
+
+  默认读取 /sys/firmware/acpi/tables 下导出的表（需要 root）；读不到或者指定 -s 时用合成的一组表
+  （FADT、256KB 的 DSDT、FACS、64 张 8KB 的 SSDT 和几张小表）。
+  导出目录里没有 RSDP 和 XSDT，这里给每张表分配一个假的物理地址，再合成 RSDP/XSDT 指向它们，
+  FADT 里的 DSDT/FACS 地址用 AcpiTablePatch 改成假地址。
+
+  报告三项：
+    build     每次 AcpiTableIndexBuild 的耗时
+    lookup    按签名查表，索引查找与逐项遍历 XSDT 比较签名（没有索引时的做法）的耗时
+    checksum  校验所有表，按字计算与逐字节计算的吞吐
+**/
+
+#include <Library/AcpiTableParseLib.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BENCH_MAX_TABLES  (ACPI_TABLE_INDEX_MAX_TABLES - 1)
+#define BENCH_BASE        0x10000000ULL   // 第一张表的假物理地址，各表按 1MB 对齐依次排开
+#define BENCH_STRIDE      0x100000ULL
+
+typedef struct {
+  UINT8   *Data;
+  UINTN   Length;
+  UINT64  Address;
+} BENCH_TABLE;
+
+typedef struct {
+  BENCH_TABLE  Tables[BENCH_MAX_TABLES + 1];   // 最后一项是 XSDT
+  UINTN        Count;
+  UINT8        Rsdp[36];
+} BENCH_DUMP;
+
+STATIC volatile UINTN  mSink;
+
+STATIC
+UINT64
+BenchNowNs (
+  VOID
+  )
+{
+  struct timespec  Ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &Ts);
+  return (UINT64)Ts.tv_sec * 1000000000ULL + (UINT64)Ts.tv_nsec;
+}
+
+STATIC
+VOID *
+EFIAPI
+BenchMap (
+  IN  VOID    *Context,
+  IN  UINT64  Address,
+  OUT UINTN   *MappedLength
+  )
+{
+  BENCH_DUMP  *Dump;
+  UINTN       Slot;
+
+  Dump = (BENCH_DUMP *)Context;
+  if (Address < BENCH_BASE) {
+    return NULL;
+  }
+  Slot = (UINTN)((Address - BENCH_BASE) / BENCH_STRIDE);
+  if (Slot > Dump->Count || Address - Dump->Tables[Slot].Address >= Dump->Tables[Slot].Length) {
+    return NULL;
+  }
+  *MappedLength = Dump->Tables[Slot].Length - (UINTN)(Address - Dump->Tables[Slot].Address);
+  return Dump->Tables[Slot].Data + (Address - Dump->Tables[Slot].Address);
+}
+
+STATIC
+VOID
+BenchAddTable (
+  IN OUT BENCH_DUMP  *Dump,
+  IN     UINT8       *Data,
+  IN     UINTN       Length
+  )
+{
+  Dump->Tables[Dump->Count].Data    = Data;
+  Dump->Tables[Dump->Count].Length  = Length;
+  Dump->Tables[Dump->Count].Address = BENCH_BASE + Dump->Count * BENCH_STRIDE;
+  Dump->Count++;
+}
+
+STATIC
+UINT8 *
+BenchMakeTable (
+  IN CONST char  *Signature,
+  IN UINT32      Length
+  )
+{
+  UINT8   *Table;
+  UINT32  Index;
+
+  Table = calloc (1, Length);
+  memcpy (Table, Signature, 4);
+  if (Length >= ACPI_TABLE_HEADER_SIZE) {
+    memcpy (Table + ACPI_TABLE_LENGTH_OFFSET, &Length, 4);
+    memcpy (Table + ACPI_TABLE_OEMID_OFFSET, "BENCH ", ACPI_TABLE_OEMID_SIZE);
+    for (Index = ACPI_TABLE_HEADER_SIZE; Index < Length; Index++) {
+      Table[Index] = (UINT8)rand ();
+    }
+    AcpiTableUpdateChecksum (Table);
+  } else {
+    memcpy (Table + ACPI_TABLE_LENGTH_OFFSET, &Length, 4);
+  }
+  return Table;
+}
+
+STATIC
+VOID
+BenchSynthesize (
+  IN OUT BENCH_DUMP  *Dump
+  )
+{
+  UINTN  Index;
+
+  BenchAddTable (Dump, BenchMakeTable ("FACP", 276), 276);
+  BenchAddTable (Dump, BenchMakeTable ("DSDT", 256 << 10), 256 << 10);
+  BenchAddTable (Dump, BenchMakeTable ("FACS", 64), 64);
+  BenchAddTable (Dump, BenchMakeTable ("APIC", 1024), 1024);
+  BenchAddTable (Dump, BenchMakeTable ("MCFG", 60), 60);
+  BenchAddTable (Dump, BenchMakeTable ("HPET", 56), 56);
+  for (Index = 0; Index < 64; Index++) {
+    BenchAddTable (Dump, BenchMakeTable ("SSDT", 8 << 10), 8 << 10);
+  }
+}
+
+//
+// 读目录下的普通文件，每个文件是一张表。读不到任何表返回 0
+//
+STATIC
+UINTN
+BenchLoadDir (
+  IN OUT BENCH_DUMP  *Dump,
+  IN     CONST char  *Dir
+  )
+{
+  char           Path[4096];
+  struct dirent  *Ent;
+  struct stat    St;
+  DIR            *D;
+  FILE           *Fp;
+  UINT8          *Data;
+
+  D = opendir (Dir);
+  if (D == NULL) {
+    return 0;
+  }
+  while ((Ent = readdir (D)) != NULL && Dump->Count < BENCH_MAX_TABLES) {
+    snprintf (Path, sizeof (Path), "%s/%s", Dir, Ent->d_name);
+    if (stat (Path, &St) != 0 || !S_ISREG (St.st_mode) || St.st_size < ACPI_TABLE_LENGTH_OFFSET + 4) {
+      continue;
+    }
+    Fp = fopen (Path, "rb");
+    if (Fp == NULL) {
+      continue;
+    }
+    Data = malloc ((size_t)St.st_size);
+    if (fread (Data, 1, (size_t)St.st_size, Fp) == (size_t)St.st_size) {
+      BenchAddTable (Dump, Data, (UINTN)St.st_size);
+    } else {
+      free (Data);
+    }
+    fclose (Fp);
+  }
+  closedir (D);
+  return Dump->Count;
+}
+
+STATIC
+UINT64
+BenchAddressOf (
+  IN CONST BENCH_DUMP  *Dump,
+  IN CONST char        *Signature
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < Dump->Count; Index++) {
+    if (memcmp (Dump->Tables[Index].Data, Signature, 4) == 0) {
+      return Dump->Tables[Index].Address;
+    }
+  }
+  return 0;
+}
+
+//
+// 合成 XSDT 和 RSDP；DSDT、FACS 不进 XSDT，FADT 里的地址改成它们的假地址
+//
+STATIC
+VOID
+BenchLink (
+  IN OUT BENCH_DUMP  *Dump
+  )
+{
+  UINT8   *Xsdt;
+  UINT8   *Fadt;
+  UINT64  Address;
+  UINT32  Length;
+  UINT32  Zero;
+  UINTN   Index;
+  UINTN   Entries;
+  UINT8   Sum;
+
+  Fadt = NULL;
+  Xsdt = calloc (1, ACPI_TABLE_HEADER_SIZE + Dump->Count * 8);
+  memcpy (Xsdt, "XSDT", 4);
+  Entries = 0;
+  for (Index = 0; Index < Dump->Count; Index++) {
+    if (memcmp (Dump->Tables[Index].Data, "DSDT", 4) == 0 || memcmp (Dump->Tables[Index].Data, "FACS", 4) == 0) {
+      continue;
+    }
+    if (memcmp (Dump->Tables[Index].Data, "FACP", 4) == 0) {
+      Fadt = Dump->Tables[Index].Data;
+    }
+    memcpy (Xsdt + ACPI_TABLE_HEADER_SIZE + Entries * 8, &Dump->Tables[Index].Address, 8);
+    Entries++;
+  }
+  Length = (UINT32)(ACPI_TABLE_HEADER_SIZE + Entries * 8);
+  memcpy (Xsdt + ACPI_TABLE_LENGTH_OFFSET, &Length, 4);
+  AcpiTableUpdateChecksum (Xsdt);
+  BenchAddTable (Dump, Xsdt, Length);
+  Dump->Count--;   // XSDT 放在最后一个槽，不算在表里
+
+  if (Fadt != NULL && ReadUnaligned32 ((CONST UINT32 *)(Fadt + ACPI_TABLE_LENGTH_OFFSET)) >= ACPI_FADT_X_DSDT_OFFSET + 8) {
+    Zero = 0;
+    AcpiTablePatch (Fadt, ACPI_FADT_FACS_OFFSET, &Zero, 4);
+    AcpiTablePatch (Fadt, ACPI_FADT_DSDT_OFFSET, &Zero, 4);
+    Address = BenchAddressOf (Dump, "FACS");
+    AcpiTablePatch (Fadt, ACPI_FADT_X_FACS_OFFSET, &Address, 8);
+    Address = BenchAddressOf (Dump, "DSDT");
+    AcpiTablePatch (Fadt, ACPI_FADT_X_DSDT_OFFSET, &Address, 8);
+  }
+
+  memset (Dump->Rsdp, 0, sizeof (Dump->Rsdp));
+  memcpy (Dump->Rsdp, "RSD PTR ", 8);
+  Dump->Rsdp[ACPI_RSDP_REVISION_OFFSET] = 2;
+  Length                                = sizeof (Dump->Rsdp);
+  memcpy (Dump->Rsdp + ACPI_RSDP_LENGTH_OFFSET, &Length, 4);
+  memcpy (Dump->Rsdp + ACPI_RSDP_XSDT_OFFSET, &Dump->Tables[Dump->Count].Address, 8);
+  Dump->Rsdp[8]  = AcpiTableCalculateChecksum8 (Dump->Rsdp, ACPI_RSDP_V1_SIZE);
+  Sum            = AcpiTableSum8 (Dump->Rsdp, sizeof (Dump->Rsdp));
+  Dump->Rsdp[32] = (UINT8)(0 - Sum);
+}
+
+//
+// 没有索引时的查表方式：逐项映射 XSDT 里的地址比较签名
+//
+STATIC
+UINT8 *
+BenchLinearFind (
+  IN BENCH_DUMP  *Dump,
+  IN UINT32      Signature
+  )
+{
+  CONST UINT8  *Xsdt;
+  UINT8        *Table;
+  UINT32       Length;
+  UINTN        Mapped;
+  UINTN        Entry;
+
+  Xsdt   = Dump->Tables[Dump->Count].Data;
+  Length = ReadUnaligned32 ((CONST UINT32 *)(Xsdt + ACPI_TABLE_LENGTH_OFFSET));
+  for (Entry = 0; Entry < (Length - ACPI_TABLE_HEADER_SIZE) / 8; Entry++) {
+    Table = BenchMap (Dump, ReadUnaligned64 ((CONST UINT64 *)(Xsdt + ACPI_TABLE_HEADER_SIZE + Entry * 8)), &Mapped);
+    if (Table != NULL && ReadUnaligned32 ((CONST UINT32 *)Table) == Signature) {
+      return Table;
+    }
+  }
+  return NULL;
+}
+
+STATIC
+UINT8
+BenchByteSum (
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  UINT8  Sum;
+
+  Sum = 0;
+  while (Length-- > 0) {
+    Sum = (UINT8)(Sum + *Buffer++);
+  }
+  return Sum;
+}
+
+int
+main (
+  int   argc,
+  char  **argv
+  )
+{
+  STATIC BENCH_DUMP        Dump;
+  STATIC ACPI_TABLE_INDEX  Index;
+  CONST char               *Dir;
+  RETURN_STATUS            Status;
+  UINT32                   Signatures[4];
+  UINTN                    Rounds;
+  UINTN                    Round;
+  UINTN                    Entry;
+  UINTN                    Bytes;
+  UINT64                   Start;
+  double                   BuildNs;
+  double                   IndexNs;
+  double                   LinearNs;
+  double                   WordNs;
+  double                   ByteNs;
+  int                      Synthetic;
+  int                      Arg;
+
+  Dir       = "/sys/firmware/acpi/tables";
+  Rounds    = 2000;
+  Synthetic = 0;
+  for (Arg = 1; Arg < argc; Arg++) {
+    if (strcmp (argv[Arg], "-n") == 0 && Arg + 1 < argc) {
+      Rounds = strtoul (argv[++Arg], NULL, 0);
+    } else if (strcmp (argv[Arg], "-s") == 0) {
+      Synthetic = 1;
+    } else if (argv[Arg][0] != '-') {
+      Dir = argv[Arg];
+    } else {
+      fprintf (stderr, "usage: %s [-n rounds] [-s | tables_dir]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (Rounds == 0) {
+    Rounds = 1;
+  }
+
+  if (Synthetic || BenchLoadDir (&Dump, Dir) == 0) {
+    if (!Synthetic) {
+      printf ("cannot read tables from %s, using synthetic tables\n", Dir);
+    }
+    BenchSynthesize (&Dump);
+  } else {
+    printf ("tables from %s\n", Dir);
+  }
+  BenchLink (&Dump);
+
+  Status = AcpiTableIndexBuild (&Index, Dump.Rsdp, BenchMap, &Dump);
+  Bytes  = 0;
+  for (Entry = 0; Entry < Dump.Count; Entry++) {
+    Bytes += Dump.Tables[Entry].Length;
+  }
+  printf ("%u tables, %u bytes, index status %u, flags 0x%x, %u indexed\n",
+          (unsigned)Dump.Count, (unsigned)Bytes, (unsigned)Status, Index.Flags, Index.Count);
+
+  Start = BenchNowNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    AcpiTableIndexBuild (&Index, Dump.Rsdp, BenchMap, &Dump);
+  }
+  BuildNs = (double)(BenchNowNs () - Start) / (double)Rounds;
+
+  //
+  // 查 XSDT 里靠后的表和不存在的表，逐项遍历在这两种情况下最慢
+  //
+  Signatures[0] = ACPI_SIG_FADT;
+  Signatures[1] = ReadUnaligned32 ((CONST UINT32 *)Dump.Tables[Dump.Count - 1].Data);
+  Signatures[2] = SIGNATURE_32 ('M', 'C', 'F', 'G');
+  Signatures[3] = SIGNATURE_32 ('N', 'O', 'N', 'E');
+  Start         = BenchNowNs ();
+  for (Round = 0; Round < Rounds * 100; Round++) {
+    mSink += (UINTN)AcpiTableIndexFind (&Index, Signatures[Round & 3], 0);
+  }
+  IndexNs = (double)(BenchNowNs () - Start) / (double)(Rounds * 100);
+  Start   = BenchNowNs ();
+  for (Round = 0; Round < Rounds * 100; Round++) {
+    mSink += (UINTN)BenchLinearFind (&Dump, Signatures[Round & 3]);
+  }
+  LinearNs = (double)(BenchNowNs () - Start) / (double)(Rounds * 100);
+
+  Start = BenchNowNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    for (Entry = 0; Entry < Dump.Count; Entry++) {
+      mSink += AcpiTableSum8 (Dump.Tables[Entry].Data, Dump.Tables[Entry].Length);
+    }
+  }
+  WordNs = (double)(BenchNowNs () - Start) / (double)Rounds;
+  Start  = BenchNowNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    for (Entry = 0; Entry < Dump.Count; Entry++) {
+      mSink += BenchByteSum (Dump.Tables[Entry].Data, Dump.Tables[Entry].Length);
+    }
+  }
+  ByteNs = (double)(BenchNowNs () - Start) / (double)Rounds;
+
+  printf ("build     %10.1f ns\n", BuildNs);
+  printf ("lookup    %10.1f ns indexed  %10.1f ns linear  %6.1fx\n", IndexNs, LinearNs, LinearNs / IndexNs);
+  printf ("checksum  %10.2f GB/s word  %10.2f GB/s byte    %6.1fx\n",
+          (double)Bytes / WordNs, (double)Bytes / ByteNs, ByteNs / WordNs);
+  return 0;
+}
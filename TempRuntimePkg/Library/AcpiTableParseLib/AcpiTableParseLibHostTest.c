@@ -0,0 +1,476 @@
+/** @file
+  AcpiTableParseLib 的主机测试，在 Linux 上直接编译运行：
+
+    gcc -O1 -g -fsanitize=address,undefined -DACPI_TABLE_PARSE_HOST \
+        -I../../Include AcpiTableParseLibHostTest.c AcpiTableParseLib.c -o AcpiTableParseLibHostTest
+
+  每张表单独 malloc 一块正好等于导出长度的内存，Map 回调只报告这块内存的长度，
+  和解析 /sys/firmware/acpi/tables 下导出的文件时一样。截断的表一旦越界读，AddressSanitizer 会直接报错。
+  全部通过返回 0。
+**/
+
+#include <Library/AcpiTableParseLib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIG_SSDT  SIGNATURE_32 ('S', 'S', 'D', 'T')
+#define SIG_APIC  SIGNATURE_32 ('A', 'P', 'I', 'C')
+
+#define MAX_REGIONS  512
+#define COUNT_OF(Array)  (sizeof (Array) / sizeof ((Array)[0]))
+
+//
+// 一张导出的表：物理地址和内存中的副本，Length 是副本实际的字节数
+//
+typedef struct {
+  UINT64  Address;
+  UINT8   *Data;
+  UINTN   Length;
+} TEST_REGION;
+
+typedef struct {
+  TEST_REGION  Regions[MAX_REGIONS];
+  UINTN        Count;
+} TEST_DUMP;
+
+STATIC UINTN  mFailures;
+
+#define CHECK(Cond)                                               \
+  do {                                                            \
+    if (!(Cond)) {                                                \
+      printf ("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #Cond); \
+      mFailures++;                                                \
+    }                                                             \
+  } while (0)
+
+STATIC
+VOID *
+EFIAPI
+TestMap (
+  IN  VOID    *Context,
+  IN  UINT64  Address,
+  OUT UINTN   *MappedLength
+  )
+{
+  TEST_DUMP  *Dump;
+  UINTN      Index;
+
+  Dump = (TEST_DUMP *)Context;
+  for (Index = 0; Index < Dump->Count; Index++) {
+    if (Address >= Dump->Regions[Index].Address &&
+        Address - Dump->Regions[Index].Address < Dump->Regions[Index].Length) {
+      *MappedLength = (UINTN)(Dump->Regions[Index].Length - (Address - Dump->Regions[Index].Address));
+      return Dump->Regions[Index].Data + (Address - Dump->Regions[Index].Address);
+    }
+  }
+  return NULL;
+}
+
+STATIC
+VOID
+TestFreeDump (
+  IN OUT TEST_DUMP  *Dump
+  )
+{
+  while (Dump->Count > 0) {
+    free (Dump->Regions[--Dump->Count].Data);
+  }
+}
+
+//
+// 加一块 Length 字节的区域，内容清零
+//
+STATIC
+UINT8 *
+TestAddRegion (
+  IN OUT TEST_DUMP  *Dump,
+  IN     UINT64     Address,
+  IN     UINTN      Length
+  )
+{
+  TEST_REGION  *Region;
+
+  Region          = &Dump->Regions[Dump->Count++];
+  Region->Address = Address;
+  Region->Data    = calloc (1, Length);
+  Region->Length  = Length;
+  return Region->Data;
+}
+
+//
+// 加一张标准表：表头 Length 为 TableLength，实际导出 DumpLength 字节（小于 TableLength 即截断）
+//
+STATIC
+UINT8 *
+TestAddTable (
+  IN OUT TEST_DUMP    *Dump,
+  IN     UINT64       Address,
+  IN     CONST char   *Signature,
+  IN     UINT32       TableLength,
+  IN     UINTN        DumpLength
+  )
+{
+  UINT8   *Table;
+  UINT32  Index;
+
+  Table = TestAddRegion (Dump, Address, DumpLength);
+  memcpy (Table, Signature, DumpLength < 4 ? DumpLength : 4);
+  if (DumpLength >= ACPI_TABLE_HEADER_SIZE) {
+    memcpy (Table + ACPI_TABLE_LENGTH_OFFSET, &TableLength, 4);
+    memcpy (Table + ACPI_TABLE_OEMID_OFFSET, "OEMID ", ACPI_TABLE_OEMID_SIZE);
+    for (Index = ACPI_TABLE_HEADER_SIZE; Index < DumpLength; Index++) {
+      Table[Index] = (UINT8)rand ();
+    }
+    if (DumpLength >= TableLength) {
+      AcpiTableUpdateChecksum (Table);
+    }
+  } else if (DumpLength >= ACPI_TABLE_LENGTH_OFFSET + 4) {
+    memcpy (Table + ACPI_TABLE_LENGTH_OFFSET, &TableLength, 4);
+  }
+  return Table;
+}
+
+//
+// 把区域缩短成 Length 字节，realloc 之后 AddressSanitizer 按新的长度检查越界
+//
+STATIC
+VOID
+TestTruncateRegion (
+  IN OUT TEST_REGION  *Region,
+  IN     UINTN        Length
+  )
+{
+  Region->Data   = realloc (Region->Data, Length);
+  Region->Length = Length;
+}
+
+STATIC
+UINT8
+ByteSum (
+  IN CONST UINT8  *Buffer,
+  IN UINTN        Length
+  )
+{
+  UINT8  Sum;
+
+  Sum = 0;
+  while (Length-- > 0) {
+    Sum = (UINT8)(Sum + *Buffer++);
+  }
+  return Sum;
+}
+
+//
+// RSDP（36 字节，修订版本 2）指向 XsdtAddress
+//
+STATIC
+VOID
+TestInitRsdp (
+  OUT UINT8   *Rsdp,
+  IN  UINT64  XsdtAddress
+  )
+{
+  UINT32  Length;
+
+  memset (Rsdp, 0, 36);
+  memcpy (Rsdp, "RSD PTR ", 8);
+  Rsdp[ACPI_RSDP_REVISION_OFFSET] = 2;
+  Length                          = 36;
+  memcpy (Rsdp + ACPI_RSDP_LENGTH_OFFSET, &Length, 4);
+  memcpy (Rsdp + ACPI_RSDP_XSDT_OFFSET, &XsdtAddress, 8);
+  Rsdp[8]  = (UINT8)(0 - ByteSum (Rsdp, ACPI_RSDP_V1_SIZE));
+  Rsdp[32] = (UINT8)(0 - ByteSum (Rsdp, 36));
+}
+
+//
+// XSDT 列出 Entries；DumpLength 为 0 时按整张表导出
+//
+STATIC
+UINT8 *
+TestAddXsdt (
+  IN OUT TEST_DUMP     *Dump,
+  IN     UINT64        Address,
+  IN     CONST UINT64  *Entries,
+  IN     UINTN         EntryCount,
+  IN     UINTN         DumpLength
+  )
+{
+  UINT32  Length;
+  UINT8   *Xsdt;
+
+  Length = (UINT32)(ACPI_TABLE_HEADER_SIZE + EntryCount * 8);
+  Xsdt   = TestAddRegion (Dump, Address, Length);
+  memcpy (Xsdt, "XSDT", 4);
+  memcpy (Xsdt + ACPI_TABLE_LENGTH_OFFSET, &Length, 4);
+  memcpy (Xsdt + ACPI_TABLE_HEADER_SIZE, Entries, EntryCount * 8);
+  AcpiTableUpdateChecksum (Xsdt);
+  if (DumpLength != 0) {
+    TestTruncateRegion (&Dump->Regions[Dump->Count - 1], DumpLength);
+  }
+  return Dump->Regions[Dump->Count - 1].Data;
+}
+
+//
+// FADT（276 字节）只填 64 位的 DSDT/FACS 地址
+//
+STATIC
+VOID
+TestAddFadt (
+  IN OUT TEST_DUMP  *Dump,
+  IN     UINT64     Address,
+  IN     UINT64     DsdtAddress,
+  IN     UINT64     FacsAddress
+  )
+{
+  UINT8  *Fadt;
+
+  Fadt = TestAddTable (Dump, Address, "FACP", 276, 276);
+  memset (Fadt + ACPI_FADT_FACS_OFFSET, 0, 8);
+  memcpy (Fadt + ACPI_FADT_X_FACS_OFFSET, &FacsAddress, 8);
+  memcpy (Fadt + ACPI_FADT_X_DSDT_OFFSET, &DsdtAddress, 8);
+  AcpiTableUpdateChecksum (Fadt);
+}
+
+STATIC
+VOID
+TestSum8 (
+  VOID
+  )
+{
+  STATIC UINT8  Buffer[100000];
+  UINTN         Iteration;
+  UINTN         Offset;
+  UINTN         Length;
+
+  for (Offset = 0; Offset < sizeof (Buffer); Offset++) {
+    Buffer[Offset] = (UINT8)rand ();
+  }
+  for (Iteration = 0; Iteration < 20000; Iteration++) {
+    Offset = (UINTN)rand () % 64;
+    Length = (UINTN)rand () % (Iteration < 10 ? sizeof (Buffer) - 64 : 3000);
+    CHECK (AcpiTableSum8 (Buffer + Offset, Length) == ByteSum (Buffer + Offset, Length));
+  }
+  memset (Buffer, 0xFF, sizeof (Buffer));
+  CHECK (AcpiTableSum8 (Buffer + 3, sizeof (Buffer) - 3) == ByteSum (Buffer + 3, sizeof (Buffer) - 3));
+}
+
+//
+// 完整的一组表：查找、修补后校验和仍然正确
+//
+STATIC
+VOID
+TestIndex (
+  VOID
+  )
+{
+  STATIC ACPI_TABLE_INDEX  Index;
+  STATIC TEST_DUMP         Dump;
+  UINT64                   Entries[] = { 0x1000, 0x4000, 0x5000, 0x6000, 0x99999999 };
+  UINT8                    Rsdp[36];
+  UINT8                    *Facs;
+  UINT32                   FacsLength;
+  UINT32                   Entry;
+
+  TestInitRsdp (Rsdp, 0x200);
+  TestAddXsdt (&Dump, 0x200, Entries, 5, 0);
+  TestAddFadt (&Dump, 0x1000, 0x2000, 0x3000);
+  TestAddTable (&Dump, 0x2000, "DSDT", 500, 500);
+  Facs       = TestAddRegion (&Dump, 0x3000, 64);
+  FacsLength = 64;
+  memcpy (Facs, "FACS", 4);
+  memcpy (Facs + ACPI_TABLE_LENGTH_OFFSET, &FacsLength, 4);
+  TestAddTable (&Dump, 0x4000, "SSDT", 100, 100);
+  TestAddTable (&Dump, 0x5000, "APIC", 80, 80);
+  TestAddTable (&Dump, 0x6000, "SSDT", 90, 90);
+
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_SUCCESS);
+  CHECK (Index.Flags == 0);
+  CHECK (Index.Count == 7);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_FADT, 0) == Dump.Regions[1].Data);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_DSDT, 0) == Dump.Regions[2].Data);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_FACS, 0) == Dump.Regions[3].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 0) == Dump.Regions[4].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 1) == Dump.Regions[6].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 2) == NULL);
+  CHECK (AcpiTableIndexFind (&Index, SIGNATURE_32 ('H', 'P', 'E', 'T'), 0) == NULL);
+
+  for (Entry = 0; Entry < Index.Count; Entry++) {
+    if (Index.Entries[Entry].Signature == ACPI_SIG_FACS) {
+      continue;
+    }
+    AcpiTablePatch (Index.Entries[Entry].Table, ACPI_TABLE_OEMID_OFFSET, "NEWID ", ACPI_TABLE_OEMID_SIZE);
+    CHECK (AcpiTableVerifyChecksum (Index.Entries[Entry].Table));
+  }
+  AcpiTablePatch (Dump.Regions[4].Data, 8, "\x07\x00\x01", 3);
+  CHECK (AcpiTableVerifyChecksum (Dump.Regions[4].Data));
+
+  TestFreeDump (&Dump);
+}
+
+//
+// 表太多同时 RSDP 校验和错误：返回值只能是其中一个，Flags 里两个都要有
+//
+STATIC
+VOID
+TestOverflowAndCrc (
+  VOID
+  )
+{
+  STATIC ACPI_TABLE_INDEX  Index;
+  STATIC TEST_DUMP         Dump;
+  STATIC UINT64            Entries[ACPI_TABLE_INDEX_MAX_TABLES + 20];
+  UINT8                    Rsdp[36];
+  UINTN                    Entry;
+  RETURN_STATUS            Status;
+
+  for (Entry = 0; Entry < COUNT_OF (Entries); Entry++) {
+    Entries[Entry] = 0x100000 + Entry * 0x100;
+  }
+  TestInitRsdp (Rsdp, 0x200);
+  TestAddXsdt (&Dump, 0x200, Entries, COUNT_OF (Entries), 0);
+  for (Entry = 0; Entry < COUNT_OF (Entries); Entry++) {
+    TestAddTable (&Dump, Entries[Entry], "SSDT", 64, 64);
+  }
+
+  //
+  // 只超限：XSDT 自己占一项
+  //
+  Status = AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump);
+  CHECK (Status == RETURN_BUFFER_TOO_SMALL);
+  CHECK (Index.Flags == ACPI_TABLE_INDEX_OVERFLOW);
+  CHECK (Index.Count == ACPI_TABLE_INDEX_MAX_TABLES);
+  CHECK (Index.Dropped == COUNT_OF (Entries) + 1 - ACPI_TABLE_INDEX_MAX_TABLES);
+
+  Rsdp[8]++;
+  Status = AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump);
+  CHECK (Status == RETURN_CRC_ERROR);
+  CHECK (Index.Flags == (ACPI_TABLE_INDEX_CRC_ERROR | ACPI_TABLE_INDEX_OVERFLOW));
+  CHECK (Index.Dropped == COUNT_OF (Entries) + 1 - ACPI_TABLE_INDEX_MAX_TABLES);
+
+  TestFreeDump (&Dump);
+}
+
+//
+// 截断的导出：被截断的表不进索引，也不能越界读（由 AddressSanitizer 检查）
+//
+STATIC
+VOID
+TestTruncated (
+  VOID
+  )
+{
+  STATIC ACPI_TABLE_INDEX  Index;
+  STATIC TEST_DUMP         Dump;
+  UINT64                   Entries[] = { 0x1000, 0x4000, 0x5000, 0x6000, 0x7000 };
+  UINT8                    Rsdp[36];
+  UINT8                    *Facs;
+  UINT32                   FacsLength;
+
+  TestInitRsdp (Rsdp, 0x200);
+  TestAddXsdt (&Dump, 0x200, Entries, 5, 0);
+  TestAddFadt (&Dump, 0x1000, 0x2000, 0x3000);
+  TestAddTable (&Dump, 0x2000, "DSDT", 5000, 1000);     // 表头说 5000 字节，只导出了 1000
+  Facs       = TestAddRegion (&Dump, 0x3000, 32);        // FACS 说 64 字节，只导出了 32
+  FacsLength = 64;
+  memcpy (Facs, "FACS", 4);
+  memcpy (Facs + ACPI_TABLE_LENGTH_OFFSET, &FacsLength, 4);
+  TestAddTable (&Dump, 0x4000, "SSDT", 100, 100);
+  TestAddTable (&Dump, 0x5000, "APIC", 80, 20);           // 连表头都不完整
+  TestAddTable (&Dump, 0x6000, "SSDT", 90, 2);            // 连 Length 字段都没有
+  TestAddTable (&Dump, 0x7000, "SSDT", 90, 90);
+
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_SUCCESS);
+  CHECK (Index.Flags == ACPI_TABLE_INDEX_TRUNCATED);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_FADT, 0) != NULL);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_DSDT, 0) == NULL);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_FACS, 0) == NULL);
+  CHECK (AcpiTableIndexFind (&Index, SIG_APIC, 0) == NULL);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 0) == Dump.Regions[4].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 1) == Dump.Regions[7].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 2) == NULL);
+
+  //
+  // XSDT 本身被截断：只走映射范围内的表项（前两项加半项），XSDT 不进索引
+  //
+  TestTruncateRegion (&Dump.Regions[0], ACPI_TABLE_HEADER_SIZE + 2 * 8 + 4);
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_SUCCESS);
+  CHECK (Index.Flags == ACPI_TABLE_INDEX_TRUNCATED);
+  CHECK (Index.Xsdt == Dump.Regions[0].Data);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_XSDT, 0) == NULL);
+  CHECK (AcpiTableIndexFind (&Index, ACPI_SIG_FADT, 0) != NULL);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 0) == Dump.Regions[4].Data);
+  CHECK (AcpiTableIndexFind (&Index, SIG_SSDT, 1) == NULL);
+
+  //
+  // 映射长度连 XSDT 表头都放不下
+  //
+  TestTruncateRegion (&Dump.Regions[0], ACPI_TABLE_HEADER_SIZE - 1);
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_NOT_FOUND);
+
+  //
+  // 直接加入一张超出映射长度的表
+  //
+  AcpiTableIndexInit (&Index);
+  CHECK (AcpiTableIndexAdd (&Index, Dump.Regions[2].Data, Dump.Regions[2].Length, TestMap, &Dump) == RETURN_INVALID_PARAMETER);
+  CHECK (Index.Count == 0 && Index.Flags == ACPI_TABLE_INDEX_TRUNCATED);
+
+  TestFreeDump (&Dump);
+}
+
+//
+// RSDP 的 Length 字段损坏：太小时拒绝，太大时只按 36 字节校验，不越过 RSDP 读（由 AddressSanitizer 检查）
+//
+STATIC
+VOID
+TestRsdpLength (
+  VOID
+  )
+{
+  STATIC ACPI_TABLE_INDEX  Index;
+  STATIC TEST_DUMP         Dump;
+  UINT64                   Entries[] = { 0x1000 };
+  UINT8                    *Rsdp;
+  UINT32                   Length;
+
+  Rsdp = malloc (ACPI_RSDP_V2_SIZE);
+  TestAddXsdt (&Dump, 0x200, Entries, 1, 0);
+  TestAddTable (&Dump, 0x1000, "SSDT", 100, 100);
+
+  TestInitRsdp (Rsdp, 0x200);
+  Length = ACPI_RSDP_XSDT_OFFSET;
+  memcpy (Rsdp + ACPI_RSDP_LENGTH_OFFSET, &Length, 4);
+  Rsdp[32] = 0;
+  Rsdp[32] = (UINT8)(0 - ByteSum (Rsdp, ACPI_RSDP_V2_SIZE));
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_INVALID_PARAMETER);
+  CHECK (Index.Count == 0 && Index.Rsdp == NULL);
+
+  TestInitRsdp (Rsdp, 0x200);
+  Length = 0xFFFFFFF0U;
+  memcpy (Rsdp + ACPI_RSDP_LENGTH_OFFSET, &Length, 4);
+  Rsdp[32] = 0;
+  Rsdp[32] = (UINT8)(0 - ByteSum (Rsdp, ACPI_RSDP_V2_SIZE));
+  CHECK (AcpiTableIndexBuild (&Index, Rsdp, TestMap, &Dump) == RETURN_SUCCESS);
+  CHECK (Index.Flags == 0 && Index.Count == 2);
+
+  free (Rsdp);
+  TestFreeDump (&Dump);
+}
+
+int
+main (
+  VOID
+  )
+{
+  TestSum8 ();
+  TestIndex ();
+  TestOverflowAndCrc ();
+  TestTruncated ();
+  TestRsdpLength ();
+
+  if (mFailures != 0) {
+    printf ("%u check(s) failed\n", (unsigned)mFailures);
+    return 1;
+  }
+  printf ("all passed\n");
+  return 0;
+}
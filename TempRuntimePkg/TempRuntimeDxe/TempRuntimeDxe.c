@@ -9,27 +9,9 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/BaseLib.h>
+#include <Library/AcpiTableParseLib.h>
 #include <Protocol/AcpiTable.h>
 
-//
-// 简易 8-bit 校验计算（ACPI 要求表字节和 = 0）
-//
-STATIC
-UINT8
-CalculateChecksum8 (
-  CONST UINT8 *Buffer,
-  UINTN        Length
-  )
-{
-  UINTN Index;
-  UINT8 Sum = 0;
-
-  for (Index = 0; Index < Length; Index++) {
-    Sum = (UINT8)(Sum + Buffer[Index]);
-  }
-  return (UINT8)(0 - Sum);
-}
-
 EFI_STATUS
 EFIAPI
 TempRuntimeDxeEntry (
@@ -78,8 +60,7 @@ TempRuntimeDxeEntry (
   //
   // 3. 计算校验
   //
-  TempTable->Header.Checksum =
-      CalculateChecksum8 ((UINT8 *)TempTable, TempTable->Header.Length);
+  AcpiTableUpdateChecksum ((UINT8 *)TempTable);
 
   //
   // 4. 安装表
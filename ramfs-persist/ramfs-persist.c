@@ -9,15 +9,47 @@
 #include <linux/pagemap.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/cred.h>
+#include <linux/capability.h>
 
 struct ramfs_persist_info ramfs_persist_ops = {
 	.sync_bound = false,
 	.lock = __SPIN_LOCK_UNLOCKED(ramfs_persist_ops.lock),
+	.writeback_delay_ms = 0,
 };
 
+// ramfs.writeback_delay_ms=，为 0 时保持同步写回
+module_param_named(writeback_delay_ms, ramfs_persist_ops.writeback_delay_ms,
+		   uint, 0644);
+MODULE_PARM_DESC(writeback_delay_ms,
+		 "Delay in ms before a flushed ramfs file is synced (0 = synchronous)");
+
+static struct workqueue_struct *ramfs_writeback_wq;
+
+/*
+ * ramfs_sync_tree 只对已经写好临时文件、还没 rename 的文件设置 tree_pending，
+ * 这期间对这些文件的单文件同步在 ramfs_tree_wait 上等待，避免目标文件被
+ * 原地改写后又被旧快照覆盖；其他文件的 close/fsync 不受影响。
+ * 多个 ramfs_sync_tree 之间用 ramfs_tree_mutex 串行，它们会写同名的临时文件。
+ */
+static DEFINE_MUTEX(ramfs_tree_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(ramfs_tree_wait);
+
+/* 已经排队、还没开始执行的写回，卸载时按 sb 找出来提前做完 */
+static LIST_HEAD(ramfs_wb_list);
+static DEFINE_SPINLOCK(ramfs_wb_lock);
+
+static void ramfs_writeback_workfn(struct work_struct *work);
+static void ramfs_hydrate_workfn(struct work_struct *work);
+
 int __ramfs_bind(const char *sync_dir_path)
 {
-	struct path sync_path;
+	struct path sync_path, old_path;
+	bool was_bound;
 	int err;
 
 	err = kern_path(sync_dir_path, LOOKUP_FOLLOW, &sync_path);
@@ -25,13 +57,16 @@ int __ramfs_bind(const char *sync_dir_path)
 		return err;
 
 	spin_lock(&ramfs_persist_ops.lock);
-	if (ramfs_persist_ops.sync_bound) {
-		path_put(&ramfs_persist_ops.sync_dir);
-	}
+	was_bound = ramfs_persist_ops.sync_bound;
+	old_path = ramfs_persist_ops.sync_dir;
 	ramfs_persist_ops.sync_dir = sync_path;
 	ramfs_persist_ops.sync_bound = true;
 	spin_unlock(&ramfs_persist_ops.lock);
 
+	// path_put 可能睡眠，放到锁外
+	if (was_bound)
+		path_put(&old_path);
+
 	return 0;
 }
 
@@ -51,184 +86,538 @@ SYSCALL_DEFINE1(ramfs_bind, const char __user *, sync_dir_path)
 }
 
 /*
- * 使用页面缓存的方式读取 ramfs 文件内容，
- * 避免在 flush/close 时对 ramfs 文件使用 __kernel_read。
+ * 取得 inode 的同步状态，create 为真时按需分配。
+ * 新分配的状态 synced 为假，第一次同步总是整体拷贝。
  */
-int ramfs_read_file(struct file *filp, void **buf, size_t *size)
+static struct ramfs_persist_inode *ramfs_persist_inode(struct inode *inode,
+						       bool create)
 {
-	struct address_space *mapping;
-	struct inode *inode;
-	size_t isize, offset = 0;
-	char *kbuf;
-	int err = 0;
+	struct ramfs_persist_inode *pi, *old;
 
-	if (!filp || !filp->f_inode)
-		return -EINVAL;
-	inode = filp->f_inode;
+	pi = smp_load_acquire(&inode->i_private);
+	if (pi || !create)
+		return pi;
 
-	isize = i_size_read(inode);
-	if (isize == 0) {
-		*buf = NULL;
-		*size = 0;
-		return 0;
+	pi = kzalloc(sizeof(*pi), GFP_KERNEL);
+	if (!pi)
+		return NULL;
+	spin_lock_init(&pi->dirty_lock);
+	mutex_init(&pi->sync_lock);
+	INIT_DELAYED_WORK(&pi->wb_work, ramfs_writeback_workfn);
+	INIT_LIST_HEAD(&pi->wb_list);
+	INIT_WORK(&pi->hydrate_work, ramfs_hydrate_workfn);
+	pi->inode = inode;
+
+	old = cmpxchg_release(&inode->i_private, NULL, pi);
+	if (old) {
+		kfree(pi);
+		return old;
 	}
-	kbuf = kmalloc(isize, GFP_KERNEL);
-	if (!kbuf)
-		return -ENOMEM;
+	return pi;
+}
+
+/*
+ * 记录脏区间 [start, end)，调用者持有 pi->dirty_lock。
+ * 区间保持有序并合并重叠或相邻部分；数量超过上限时
+ * 合并间隔最小的两个相邻区间，只会多写一些干净数据。
+ */
+static void ramfs_dirty_add(struct ramfs_persist_inode *pi, loff_t start,
+			    loff_t end)
+{
+	struct ramfs_dirty_range *r = pi->ranges;
+	unsigned int i, j, n = pi->nr_ranges, best;
+
+	if (start >= end)
+		return;
+
+	for (i = n; i > 0 && r[i - 1].start > start; i--)
+		r[i] = r[i - 1];
+	r[i].start = start;
+	r[i].end = end;
+	n++;
+
+	for (i = 0, j = 1; j < n; j++) {
+		if (r[j].start <= r[i].end)
+			r[i].end = max(r[i].end, r[j].end);
+		else
+			r[++i] = r[j];
+	}
+	n = i + 1;
+
+	if (n > RAMFS_PERSIST_MAX_RANGES) {
+		best = 0;
+		for (i = 1; i + 1 < n; i++) {
+			if (r[i + 1].start - r[i].end <
+			    r[best + 1].start - r[best].end)
+				best = i;
+		}
+		r[best].end = r[best + 1].end;
+		memmove(&r[best + 1], &r[best + 2],
+			(n - best - 2) * sizeof(*r));
+		n--;
+	}
+	pi->nr_ranges = n;
+}
+
+ssize_t ramfs_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct ramfs_persist_inode *pi;
+	ssize_t ret;
+
+	ret = generic_file_write_iter(iocb, from);
+	if (ret <= 0)
+		return ret;
+
+	pi = ramfs_persist_inode(file_inode(iocb->ki_filp), true);
+	if (pi) {
+		spin_lock(&pi->dirty_lock);
+		ramfs_dirty_add(pi, iocb->ki_pos - ret, iocb->ki_pos);
+		spin_unlock(&pi->dirty_lock);
+	}
+	return ret;
+}
+
+/*
+ * 通过共享可写映射的修改不经过 write_iter，
+ * 这里只能把整个文件标记为需要完整同步。
+ */
+int ramfs_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ramfs_persist_inode *pi;
+
+	if ((vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) ==
+	    (VM_SHARED | VM_MAYWRITE)) {
+		pi = ramfs_persist_inode(file_inode(file), true);
+		if (!pi)
+			return -ENOMEM;
+		spin_lock(&pi->dirty_lock);
+		pi->mmap_dirty = true;
+		spin_unlock(&pi->dirty_lock);
+	}
+	return generic_file_mmap(file, vma);
+}
+
+/*
+ * truncate 缩短文件时，把 [新大小, 旧大小) 记为脏区间。
+ * 之后又写回或扩展到这段范围时，同步会用新内容（或零）覆盖目标文件里的旧字节；
+ * 一直没有扩展时，这段区间在同步时被按大小截掉，目标文件随之截短。
+ * 分配不到同步状态时，下一次同步本来就是完整拷贝，不需要额外记录。
+ */
+int ramfs_persist_setattr(struct user_namespace *mnt_userns,
+			  struct dentry *dentry, struct iattr *ia)
+{
+	struct inode *inode = d_inode(dentry);
+	struct ramfs_persist_inode *pi;
+	loff_t oldsize = i_size_read(inode);
+	int err;
+
+	err = simple_setattr(mnt_userns, dentry, ia);
+	if (err || !(ia->ia_valid & ATTR_SIZE) || ia->ia_size >= oldsize)
+		return err;
+
+	pi = ramfs_persist_inode(inode, false);
+	if (pi) {
+		spin_lock(&pi->dirty_lock);
+		ramfs_dirty_add(pi, ia->ia_size, oldsize);
+		spin_unlock(&pi->dirty_lock);
+	}
+	return 0;
+}
+
+void ramfs_persist_evict_inode(struct inode *inode)
+{
+	struct ramfs_persist_inode *pi = inode->i_private;
 
-	mapping = inode->i_mapping;
-	while (offset < isize) {
-		size_t page_off = offset & (PAGE_SIZE - 1);
+	truncate_inode_pages_final(&inode->i_data);
+	clear_inode(inode);
+	if (pi) {
+		// 排队中的写回和载入都持有引用，走到这里时不会再有待处理的工作
+		cancel_delayed_work_sync(&pi->wb_work);
+		if (pi->hydrate_src.dentry)
+			path_put(&pi->hydrate_src);
+		if (pi->hydrate_cred)
+			put_cred(pi->hydrate_cred);
+		kfree(pi);
+		inode->i_private = NULL;
+	}
+}
+
+/*
+ * 直接从 ramfs 的页面缓存逐页写入目标文件，
+ * 不再先把整个文件 kmalloc 出一份副本，额外内存占用与文件大小无关。
+ * 文件中没有页面的空洞部分用零页填充。
+ */
+static int ramfs_copy_range(struct inode *inode, struct file *dst,
+			    loff_t start, loff_t end)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t offset = start;
+
+	while (offset < end) {
+		size_t page_off = offset_in_page(offset);
 		pgoff_t index = offset >> PAGE_SHIFT;
 		size_t copy_len =
-			min_t(size_t, PAGE_SIZE - page_off, isize - offset);
+			min_t(loff_t, PAGE_SIZE - page_off, end - offset);
+		loff_t pos = offset;
 		struct page *page;
+		ssize_t written;
+		void *kaddr;
 
-		page = read_mapping_page(mapping, index, NULL);
-		if (IS_ERR(page)) {
-			err = PTR_ERR(page);
-			break;
-		}
-		if (!page) {
-			err = -EIO;
-			break;
-		}
-		if (PageError(page)) {
+		page = find_get_page(mapping, index);
+		if (page)
+			kaddr = kmap(page);
+		else
+			kaddr = page_address(ZERO_PAGE(0));
+
+		written = kernel_write(dst, kaddr + page_off, copy_len, &pos);
+
+		if (page) {
+			kunmap(page);
 			put_page(page);
-			err = -EIO;
-			break;
 		}
-
-		// 拷贝数据
-		memcpy(kbuf + offset, page_address(page) + page_off, copy_len);
+		if (written < 0)
+			return written;
+		if (written != copy_len)
+			return -EIO;
 		offset += copy_len;
-		put_page(page);
+		cond_resched();
+	}
+	return 0;
+}
+
+/*
+ * 全局锁只保护 sync 目录的绑定关系：在锁内拿到路径引用后立即释放，
+ * 之后的 I/O 都不再持有全局锁。未绑定时返回 false。
+ */
+static bool ramfs_get_sync_dir(struct path *sync_dir)
+{
+	bool bound;
+
+	spin_lock(&ramfs_persist_ops.lock);
+	bound = ramfs_persist_ops.sync_bound;
+	if (bound) {
+		*sync_dir = ramfs_persist_ops.sync_dir;
+		path_get(sync_dir);
+	}
+	spin_unlock(&ramfs_persist_ops.lock);
+	return bound;
+}
+
+/*
+ * 拼出 dentry 在 sync 目录下对应的路径，结果用 __putname 释放。
+ * 缓冲区来自 names_cache，避免在内核栈上放多个 PATH_MAX 数组。
+ */
+static char *ramfs_target_path(const struct path *sync_dir,
+			       struct dentry *dentry)
+{
+	char *buf, *tmp, *dir, *rel;
+	size_t len;
+	int err = 0;
+
+	buf = __getname();
+	if (!buf)
+		return ERR_PTR(-ENOMEM);
+	tmp = __getname();
+	if (!tmp) {
+		__putname(buf);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	dir = d_path(sync_dir, buf, PATH_MAX);
+	rel = dentry_path_raw(dentry, tmp, PATH_MAX);
+	if (IS_ERR(dir)) {
+		err = PTR_ERR(dir);
+		pr_err("Failed to get sync_dir path: %d\n", err);
+	} else if (IS_ERR(rel)) {
+		err = PTR_ERR(rel);
+	} else {
+		len = strlen(dir);
+		memmove(buf, dir, len);
+		if (snprintf(buf + len, PATH_MAX - len, "%s", rel) >=
+		    PATH_MAX - len)
+			err = -ENAMETOOLONG;
 	}
 
+	__putname(tmp);
 	if (err) {
-		kfree(kbuf);
-		return err;
+		__putname(buf);
+		return ERR_PTR(err);
 	}
-	*buf = kbuf;
-	*size = isize;
-	return 0;
+	return buf;
 }
 
 /*
- * 显式同步逻辑：从 ramfs 文件读取，再写到 /tmp 目录下。
- * 避免在文件 flush/close 时执行该流程。
+ * 显式同步逻辑：把 ramfs 文件中变化过的区间写到绑定的 sync 目录下。
+ * 目标文件不再截断重写，没有任何变化时直接跳过。
+ * 只依赖 dentry，写回队列里没有打开的 file 也可以调用。
+ *
+ * 拷贝过程只持有该 inode 自己的 sync_lock，不同文件的同步可以
+ * 在不同 CPU 上并行；同一文件的并发同步则排队，保证后返回的一方
+ * 看到的数据已经落盘。
  */
-int ramfs_do_sync(struct file *src)
+static int ramfs_sync_dentry(struct dentry *dentry)
 {
 	int err = 0;
-	char path_buf[PATH_MAX], *rel_path;
-	char full_path[PATH_MAX];
-	void *data = NULL;
-	size_t size = 0;
+	char *full_path;
+	struct ramfs_dirty_range ranges[RAMFS_PERSIST_MAX_RANGES];
+	struct ramfs_persist_inode *pi;
+	struct inode *inode;
+	unsigned int nr_ranges = 0, i;
+	bool full;
+	loff_t size;
 	struct path sync_dir_local;
 	struct file *dst = NULL;
-	loff_t pos = 0;
 
-	if (!src || !src->f_inode)
+	if (!dentry || d_really_is_negative(dentry))
 		return -EINVAL;
+	inode = d_inode(dentry);
 
 	// 检查一下是否是 ramfs 文件
-	if (strcmp(src->f_inode->i_sb->s_type->name, "ramfs") != 0)
+	if (strcmp(inode->i_sb->s_type->name, "ramfs") != 0)
 		return 0; // 非 ramfs，直接返回
 
 	// 获取 sync 目录
-	spin_lock(&ramfs_persist_ops.lock);
-	if (!ramfs_persist_ops.sync_bound) {
-		spin_unlock(&ramfs_persist_ops.lock);
+	if (!ramfs_get_sync_dir(&sync_dir_local))
 		return 0;
-	}
-	sync_dir_local = ramfs_persist_ops.sync_dir;
-	path_get(&sync_dir_local);
-	spin_unlock(&ramfs_persist_ops.lock);
 
-	// 读取文件内容（使用页面缓存）
-	err = ramfs_read_file(src, &data, &size);
-	if (err) {
-		pr_err("ramfs_sync: read failed at pos 0: %d\n", err);
+	pi = ramfs_persist_inode(inode, true);
+	if (!pi) {
+		err = -ENOMEM;
 		goto out_put;
 	}
-	pr_info("ramfs_sync: source file size = %zu\n", size);
-
-	// 可自行决定写到什么路径，这里示例 /tmp
-	rel_path =
-		dentry_path_raw(src->f_path.dentry, path_buf, sizeof(path_buf));
-	if (IS_ERR(rel_path)) {
-		err = PTR_ERR(rel_path);
-		goto out_free;
+	// 这个文件正在被 ramfs_sync_tree 替换，等它 rename 完成
+	for (;;) {
+		mutex_lock(&pi->sync_lock);
+		if (!pi->tree_pending)
+			break;
+		mutex_unlock(&pi->sync_lock);
+		wait_event(ramfs_tree_wait, !READ_ONCE(pi->tree_pending));
 	}
 
-	char sync_dir_buf[PATH_MAX];
-	char *sync_dir_str = NULL;
-	sync_dir_str = d_path(&ramfs_persist_ops.sync_dir, sync_dir_buf,
-			      sizeof(sync_dir_buf));
-	if (IS_ERR(sync_dir_str)) {
-		err = PTR_ERR(sync_dir_str);
-		pr_err("Failed to get sync_dir path: %d\n", err);
-		goto out_put;
+	// 内容还没从 sync 目录载入，说明和 sync 目录中的副本一致
+	if (pi->hydrate_src.dentry)
+		goto out_unlock;
+
+	/*
+	 * 取出并清空脏区间。同步期间新写入的数据会记录到新的区间里，
+	 * 留给下一次同步；同步失败时退回到完整同步。
+	 *
+	 * 文件大小要在取出区间之后读：write_iter 先更新 i_size 再记录区间，
+	 * 这样取到的每个区间都落在 size 以内，下面按 size 截掉的只可能是
+	 * 被 truncate 缩短掉的部分，而缩短本身也记成了脏区间。
+	 * 仍然处于可写映射中的文件保留 mmap_dirty，映射期间的修改留给下一次同步。
+	 */
+	spin_lock(&pi->dirty_lock);
+	full = !pi->synced || pi->mmap_dirty ||
+	       mapping_writably_mapped(inode->i_mapping);
+	nr_ranges = pi->nr_ranges;
+	memcpy(ranges, pi->ranges, nr_ranges * sizeof(*ranges));
+	pi->nr_ranges = 0;
+	if (!mapping_writably_mapped(inode->i_mapping))
+		pi->mmap_dirty = false;
+	size = i_size_read(inode);
+	if (!full && !nr_ranges && size == pi->synced_size) {
+		spin_unlock(&pi->dirty_lock);
+		goto out_unlock;
 	}
+	spin_unlock(&pi->dirty_lock);
+	pr_info("ramfs_sync: source file size = %lld, %s\n", size,
+		full ? "full copy" : "dirty ranges only");
 
-	snprintf(full_path, sizeof(full_path), "%s/%s", sync_dir_str, rel_path);
+	full_path = ramfs_target_path(&sync_dir_local, dentry);
+	if (IS_ERR(full_path)) {
+		err = PTR_ERR(full_path);
+		goto out_fail;
+	}
 	pr_info("ramfs_sync: copying to %s\n", full_path);
 
-	// 打开目标文件
-	dst = filp_open(full_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	// 打开目标文件，不截断，只覆盖变化的部分；新建时沿用 ramfs 文件的权限位
+	dst = filp_open(full_path, O_WRONLY | O_CREAT, inode->i_mode & S_IRWXUGO);
+	__putname(full_path);
 	if (IS_ERR(dst)) {
 		err = PTR_ERR(dst);
 		pr_err("ramfs_sync: open dst failed: %d\n", err);
-		goto out_free;
+		goto out_fail;
 	}
 
-	spin_lock(&ramfs_persist_ops.lock);
-	if (size > 0) {
-		ssize_t written = kernel_write(dst, data, size, &pos);
-		if (written < 0 || written != size) {
-			err = (written < 0) ? written : -EIO;
-			pr_err("ramfs_sync: write failed: %zd\n", written);
-		} else {
-			pr_info("ramfs_sync: successfully copied %zu bytes\n",
-				size);
-		}
-		if (!err) {
-			// 同步到磁盘
-			err = vfs_fsync(dst, 0);
-			if (err)
-				pr_err("ramfs_sync: fsync failed: %d\n", err);
+	// 逐页从页面缓存写出，不经过中间缓冲区
+	if (full) {
+		err = ramfs_copy_range(inode, dst, 0, size);
+	} else {
+		for (i = 0; i < nr_ranges && !err; i++) {
+			if (ranges[i].start >= size)
+				break;
+			err = ramfs_copy_range(inode, dst, ranges[i].start,
+					       min(ranges[i].end, size));
 		}
 	}
-	spin_unlock(&ramfs_persist_ops.lock);
+	if (err)
+		pr_err("ramfs_sync: write failed: %d\n", err);
+
+	// 文件被截断或通过 truncate 扩展时，让目标文件大小保持一致
+	if (!err && i_size_read(file_inode(dst)) != size) {
+		err = vfs_truncate(&dst->f_path, size);
+		if (err)
+			pr_err("ramfs_sync: truncate dst failed: %d\n", err);
+	}
+	if (!err) {
+		// 同步到磁盘
+		err = vfs_fsync(dst, 0);
+		if (err)
+			pr_err("ramfs_sync: fsync failed: %d\n", err);
+	}
 
 	filp_close(dst, NULL);
 
-out_free:
-	kfree(data);
+out_fail:
+	spin_lock(&pi->dirty_lock);
+	if (err) {
+		pi->synced = false;
+	} else {
+		pi->synced = true;
+		pi->synced_size = size;
+	}
+	spin_unlock(&pi->dirty_lock);
+out_unlock:
+	mutex_unlock(&pi->sync_lock);
 out_put:
 	path_put(&sync_dir_local);
 	return err;
 }
 
+int ramfs_do_sync(struct file *src)
+{
+	if (!src)
+		return -EINVAL;
+	return ramfs_sync_dentry(src->f_path.dentry);
+}
+
+/*
+ * 异步写回没有调用者可以返回错误，记到 mapping 的 errseq 上，
+ * 由之后的 fsync/close 通过 file_check_and_advance_wb_err 报告给每个打开的文件。
+ */
+static void ramfs_writeback_workfn(struct work_struct *work)
+{
+	struct ramfs_persist_inode *pi = container_of(
+		to_delayed_work(work), struct ramfs_persist_inode, wb_work);
+	struct dentry *dentry;
+	int err;
+
+	spin_lock(&ramfs_wb_lock);
+	dentry = pi->wb_dentry;
+	pi->wb_dentry = NULL;
+	list_del_init(&pi->wb_list);
+	spin_unlock(&ramfs_wb_lock);
+
+	if (!dentry)
+		return;
+
+	err = ramfs_sync_dentry(dentry);
+	if (err) {
+		pr_err("ramfs_sync: writeback failed: %d\n", err);
+		mapping_set_error(pi->inode->i_mapping, err);
+	}
+	dput(dentry);
+}
+
+/*
+ * 卸载前把这个 sb 上排队中的写回立即做完，之后不会再有工作引用它的 dentry。
+ * 此时已经没有打开的文件，不会有新的写回排队。
+ */
+void ramfs_persist_kill_sb(struct super_block *sb)
+{
+	struct ramfs_persist_inode *pi;
+	bool found;
+
+	do {
+		found = false;
+		spin_lock(&ramfs_wb_lock);
+		list_for_each_entry(pi, &ramfs_wb_list, wb_list) {
+			if (pi->inode->i_sb == sb) {
+				found = true;
+				break;
+			}
+		}
+		spin_unlock(&ramfs_wb_lock);
+		// 排队中的 dentry 让 inode 和 pi 一直有效，工作函数执行完才会从链表上摘下
+		if (found) {
+			mod_delayed_work(ramfs_writeback_wq, &pi->wb_work, 0);
+			flush_delayed_work(&pi->wb_work);
+		}
+	} while (found);
+}
+
+/*
+ * 把文件挂到写回队列上，延迟 writeback_delay_ms 后同步。
+ * 已经排队的 inode 不会重复排队，延迟期间的多次请求合并为一次同步。
+ * 只持有 dentry 引用，不持有挂载，卸载时由 ramfs_persist_kill_sb 提前做完。
+ */
+static int ramfs_queue_writeback(struct file *file)
+{
+	unsigned int delay_ms = READ_ONCE(ramfs_persist_ops.writeback_delay_ms);
+	struct inode *inode = file_inode(file);
+	struct ramfs_persist_inode *pi;
+
+	if (!delay_ms || !ramfs_writeback_wq ||
+	    strcmp(inode->i_sb->s_type->name, "ramfs") != 0)
+		return ramfs_do_sync(file);
+
+	pi = ramfs_persist_inode(inode, true);
+	if (!pi)
+		return ramfs_do_sync(file);
+
+	spin_lock(&ramfs_wb_lock);
+	if (!pi->wb_dentry) {
+		pi->wb_dentry = dget(file->f_path.dentry);
+		list_add_tail(&pi->wb_list, &ramfs_wb_list);
+	}
+	spin_unlock(&ramfs_wb_lock);
+
+	queue_delayed_work(ramfs_writeback_wq, &pi->wb_work,
+			   msecs_to_jiffies(delay_ms));
+	return 0;
+}
+
+/*
+ * 显式同步前先等待该 inode 已排队的写回完成，
+ * 再补做一次同步，覆盖排队之后的新写入。
+ * 之前的异步写回失败过时，即使这次同步成功也要报告给调用者。
+ */
+static int ramfs_sync_now(struct file *file)
+{
+	struct ramfs_persist_inode *pi;
+	int err, wb_err;
+
+	pi = ramfs_persist_inode(file_inode(file), false);
+	if (pi)
+		flush_delayed_work(&pi->wb_work);
+	err = ramfs_do_sync(file);
+	wb_err = file_check_and_advance_wb_err(file);
+	return err ? err : wb_err;
+}
+
 /*
- * 不要在 flush 时自动调用同步，以免在 close 的时机读取文件。
- * 让用户态自己显式调用 ramfs_file_flush syscall 来做同步。
+ * flush/close 时默认同步写回；设置了 writeback_delay_ms 后
+ * 只排队，由写回队列异步完成，close 返回的是此前异步写回的错误。
  */
 int ramfs_file_flush(struct file *file, fl_owner_t id)
 {
-	return ramfs_do_sync(file);
+	int err, wb_err;
+
+	wb_err = file_check_and_advance_wb_err(file);
+	err = ramfs_queue_writeback(file);
+	return err ? err : wb_err;
 }
 
 int ramfs_file_fsync(struct file *file, loff_t start, loff_t end,
 			    int datasync)
 {
-	return ramfs_do_sync(file);
+	return ramfs_sync_now(file);
 }
 
 int ramfs_file_release(struct inode *inode, struct file *file)
 {
-	return ramfs_do_sync(file);
+	return ramfs_queue_writeback(file);
 }
 
 // 在用户态可通过 fd 调用该系统调用，显式发起同步
@@ -241,7 +630,902 @@ SYSCALL_DEFINE1(ramfs_file_flush, int, fd)
 		return -EBADF;
 	}
 
-	err = ramfs_do_sync(f.file);
+	err = ramfs_sync_now(f.file);
 	fdput(f);
 	return err;
-}
\ No newline at end of file
+}
+
+/*
+ * 目录树遍历：按层遍历 root 下的所有目录项，对每一项调用 actor，
+ * rel 是相对 root 的路径。先把一个目录的内容收集到链表里，
+ * 关闭目录后再调用 actor，避免在持有目录锁时做查找和创建。
+ */
+typedef int (*ramfs_walk_actor_t)(const char *rel, unsigned int type,
+				  void *arg);
+
+struct ramfs_walk_ent {
+	struct list_head list;
+	unsigned int type;
+	char rel[];
+};
+
+struct ramfs_walk_ctx {
+	struct dir_context ctx;
+	struct list_head *entries;
+	const char *prefix;
+	int err;
+};
+
+static int ramfs_walk_filldir(struct dir_context *ctx, const char *name,
+			      int namelen, loff_t offset, u64 ino,
+			      unsigned int d_type)
+{
+	struct ramfs_walk_ctx *wctx =
+		container_of(ctx, struct ramfs_walk_ctx, ctx);
+	size_t plen = strlen(wctx->prefix);
+	struct ramfs_walk_ent *ent;
+
+	if ((namelen == 1 && name[0] == '.') ||
+	    (namelen == 2 && name[0] == '.' && name[1] == '.'))
+		return 0;
+
+	ent = kmalloc(sizeof(*ent) + plen + 1 + namelen + 1, GFP_KERNEL);
+	if (!ent) {
+		wctx->err = -ENOMEM;
+		return -ENOMEM;
+	}
+	ent->type = d_type;
+	if (plen) {
+		memcpy(ent->rel, wctx->prefix, plen);
+		ent->rel[plen++] = '/';
+	}
+	memcpy(ent->rel + plen, name, namelen);
+	ent->rel[plen + namelen] = '\0';
+	list_add_tail(&ent->list, wctx->entries);
+	return 0;
+}
+
+static int ramfs_walk_list(const char *root, const char *prefix,
+			   struct list_head *entries)
+{
+	struct ramfs_walk_ctx wctx = {
+		.ctx.actor = ramfs_walk_filldir,
+		.entries = entries,
+		.prefix = prefix,
+	};
+	struct file *dir;
+	char *path;
+	int err;
+
+	path = *prefix ? kasprintf(GFP_KERNEL, "%s/%s", root, prefix) :
+			 kstrdup(root, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	dir = filp_open(path, O_RDONLY | O_DIRECTORY, 0);
+	kfree(path);
+	if (IS_ERR(dir))
+		return PTR_ERR(dir);
+
+	err = iterate_dir(dir, &wctx.ctx);
+	filp_close(dir, NULL);
+	return wctx.err ? wctx.err : err;
+}
+
+// 部分文件系统的 d_type 为 DT_UNKNOWN，此时查一下 inode
+static unsigned int ramfs_walk_type(const char *root, const char *rel)
+{
+	struct path path;
+	unsigned int type = DT_UNKNOWN;
+	char *full;
+
+	full = kasprintf(GFP_KERNEL, "%s/%s", root, rel);
+	if (!full)
+		return DT_UNKNOWN;
+	if (!kern_path(full, 0, &path)) {
+		if (d_is_dir(path.dentry))
+			type = DT_DIR;
+		else if (d_is_reg(path.dentry))
+			type = DT_REG;
+		path_put(&path);
+	}
+	kfree(full);
+	return type;
+}
+
+static int ramfs_walk_tree(const char *root, ramfs_walk_actor_t actor,
+			   void *arg)
+{
+	LIST_HEAD(dirs);
+	LIST_HEAD(entries);
+	struct ramfs_walk_ent *dir = NULL, *ent, *tmp;
+	const char *prefix = "";
+	int err = 0;
+
+	for (;;) {
+		err = ramfs_walk_list(root, prefix, &entries);
+		list_for_each_entry_safe(ent, tmp, &entries, list) {
+			list_del(&ent->list);
+			if (!err && ent->type == DT_UNKNOWN)
+				ent->type = ramfs_walk_type(root, ent->rel);
+			if (!err)
+				err = actor(ent->rel, ent->type, arg);
+			if (!err && ent->type == DT_DIR)
+				list_add_tail(&ent->list, &dirs);
+			else
+				kfree(ent);
+		}
+		if (*prefix)
+			kfree(dir);
+		if (err || list_empty(&dirs))
+			break;
+		dir = list_first_entry(&dirs, struct ramfs_walk_ent, list);
+		list_del(&dir->list);
+		prefix = dir->rel;
+		cond_resched();
+	}
+
+	list_for_each_entry_safe(ent, tmp, &dirs, list)
+		kfree(ent);
+	return err;
+}
+
+/*
+ * 把 sync 目录中的副本载入 ramfs inode。直接经过页面缓存的
+ * write_begin/write_end 填充，不打开 ramfs 文件，
+ * 因此不会触发 flush/release 同步，也不会记录脏区间。
+ */
+static int ramfs_fill_from(struct inode *inode, struct file *src)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t size = i_size_read(file_inode(src));
+	loff_t offset = 0;
+	int err = 0;
+
+	inode_lock(inode);
+	while (offset < size) {
+		size_t page_off = offset_in_page(offset);
+		size_t len = min_t(loff_t, PAGE_SIZE - page_off, size - offset);
+		loff_t pos = offset;
+		struct page *page;
+		void *fsdata;
+		ssize_t nread;
+
+		err = pagecache_write_begin(NULL, mapping, offset, len, 0,
+					    &page, &fsdata);
+		if (err)
+			break;
+		nread = kernel_read(src, kmap(page) + page_off, len, &pos);
+		kunmap(page);
+
+		err = pagecache_write_end(NULL, mapping, offset, len,
+					  nread < 0 ? 0 : nread, page, fsdata);
+		if (nread < 0) {
+			err = nread;
+			break;
+		}
+		if (err < 0)
+			break;
+		err = 0;
+		// 副本在载入过程中变短了，按新的长度结束
+		if (nread < len)
+			break;
+		offset += len;
+		cond_resched();
+	}
+	inode_unlock(inode);
+	return err;
+}
+
+struct ramfs_restore_ctx {
+	const char *src_root;
+	const char *dst_root;
+	const struct cred *cred;   /* 调用 ramfs_restore 的进程的凭据 */
+	unsigned int flags;
+	atomic_t pending;
+	struct completion done;
+	int err;
+};
+
+/*
+ * 载入一个 inode 的内容，open 和后台工作都会调用，由 sync_lock 串行化，
+ * 先到的一方完成载入，后到的直接返回。失败时保留 hydrate_src，
+ * 之后的 open 会重试；也不会把不完整的内容同步回 sync 目录。
+ *
+ * 副本总是以发起 ramfs_restore 的进程的凭据打开，而不是 kworker
+ * 或者第一个 open 该文件的进程的凭据，调用者读不到的副本也载入不进来。
+ */
+static int ramfs_hydrate_inode(struct ramfs_persist_inode *pi)
+{
+	struct file *src;
+	int err = 0;
+
+	mutex_lock(&pi->sync_lock);
+	if (!pi->hydrate_src.dentry)
+		goto out_unlock;
+
+	src = dentry_open(&pi->hydrate_src, O_RDONLY, pi->hydrate_cred);
+	if (IS_ERR(src)) {
+		err = PTR_ERR(src);
+		goto out_unlock;
+	}
+	err = ramfs_fill_from(pi->inode, src);
+	fput(src);
+	if (err) {
+		pr_err("ramfs_restore: load failed: %d\n", err);
+		goto out_unlock;
+	}
+
+	path_put(&pi->hydrate_src);
+	pi->hydrate_src.mnt = NULL;
+	pi->hydrate_src.dentry = NULL;
+	put_cred(pi->hydrate_cred);
+	pi->hydrate_cred = NULL;
+
+	spin_lock(&pi->dirty_lock);
+	pi->nr_ranges = 0;
+	pi->synced = true;
+	pi->synced_size = i_size_read(pi->inode);
+	spin_unlock(&pi->dirty_lock);
+
+out_unlock:
+	mutex_unlock(&pi->sync_lock);
+	return err;
+}
+
+static void ramfs_hydrate_workfn(struct work_struct *work)
+{
+	struct ramfs_persist_inode *pi =
+		container_of(work, struct ramfs_persist_inode, hydrate_work);
+	struct ramfs_restore_ctx *ctx = pi->hydrate_ctx;
+	struct inode *inode = pi->inode;
+	int err;
+
+	pi->hydrate_ctx = NULL;
+	err = ramfs_hydrate_inode(pi);
+	if (ctx) {
+		if (err)
+			cmpxchg(&ctx->err, 0, err);
+		if (atomic_dec_and_test(&ctx->pending))
+			complete(&ctx->done);
+	}
+	iput(inode);
+}
+
+int ramfs_file_open(struct inode *inode, struct file *file)
+{
+	struct ramfs_persist_inode *pi;
+	int err;
+
+	pi = ramfs_persist_inode(inode, false);
+	if (pi && READ_ONCE(pi->hydrate_src.dentry)) {
+		err = ramfs_hydrate_inode(pi);
+		if (err)
+			return err;
+	}
+	return generic_file_open(inode, file);
+}
+
+/*
+ * 新建的文件和目录沿用副本的权限位和属主。属主只在调用者有 CAP_CHOWN 时复制，
+ * 否则归调用者所有；没有 CAP_FSETID 时去掉 setuid/setgid 位。
+ * ramfs 的 inode 只在内存里，直接改字段即可，不需要走 notify_change。
+ */
+static void ramfs_restore_attrs(struct inode *inode, const struct inode *src)
+{
+	umode_t mode = src->i_mode & S_IALLUGO;
+
+	if (!capable(CAP_FSETID))
+		mode &= ~(S_ISUID | S_ISGID);
+
+	inode_lock(inode);
+	inode->i_mode = (inode->i_mode & S_IFMT) | mode;
+	if (capable(CAP_CHOWN)) {
+		inode->i_uid = src->i_uid;
+		inode->i_gid = src->i_gid;
+	}
+	inode_unlock(inode);
+}
+
+/*
+ * 在 ramfs 中建出一个空文件，记录它在 sync 目录中的副本。
+ * ramfs 中已经存在的文件保持不动，不会被旧副本覆盖。
+ */
+static int ramfs_restore_file(struct ramfs_restore_ctx *ctx, const char *rel)
+{
+	struct ramfs_persist_inode *pi;
+	struct path parent, src_path;
+	struct dentry *dentry;
+	struct inode *inode;
+	char *path;
+	int err;
+
+	path = kasprintf(GFP_KERNEL, "%s/%s", ctx->src_root, rel);
+	if (!path)
+		return -ENOMEM;
+	err = kern_path(path, 0, &src_path);
+	kfree(path);
+	if (err)
+		return err;
+
+	path = kasprintf(GFP_KERNEL, "%s/%s", ctx->dst_root, rel);
+	if (!path) {
+		err = -ENOMEM;
+		goto out_src;
+	}
+	dentry = kern_path_create(AT_FDCWD, path, &parent, 0);
+	kfree(path);
+	if (IS_ERR(dentry)) {
+		err = PTR_ERR(dentry);
+		if (err == -EEXIST)
+			err = 0;
+		goto out_src;
+	}
+
+	// 先以 0600 建出，补上属主和权限之前其他用户打不开
+	err = vfs_create(&init_user_ns, d_inode(parent.dentry), dentry,
+			 S_IFREG | 0600, true);
+	if (err)
+		goto out_done;
+	inode = d_inode(dentry);
+	ramfs_restore_attrs(inode, d_inode(src_path.dentry));
+
+	pi = ramfs_persist_inode(inode, true);
+	if (!pi) {
+		err = -ENOMEM;
+		goto out_done;
+	}
+	mutex_lock(&pi->sync_lock);
+	pi->hydrate_src = src_path;
+	path_get(&pi->hydrate_src);
+	pi->hydrate_cred = get_cred(ctx->cred);
+	// 载入前 stat 就能看到正确的大小
+	i_size_write(inode, i_size_read(d_inode(src_path.dentry)));
+	mutex_unlock(&pi->sync_lock);
+
+	if (!(ctx->flags & RAMFS_RESTORE_LAZY)) {
+		ihold(inode);
+		if (ramfs_writeback_wq) {
+			atomic_inc(&ctx->pending);
+			pi->hydrate_ctx = ctx;
+			queue_work(ramfs_writeback_wq, &pi->hydrate_work);
+		} else {
+			err = ramfs_hydrate_inode(pi);
+			iput(inode);
+		}
+	}
+
+out_done:
+	done_path_create(&parent, dentry);
+out_src:
+	path_put(&src_path);
+	return err;
+}
+
+static bool ramfs_is_tmp_name(const char *name)
+{
+	size_t len = strlen(name), slen = strlen(RAMFS_SYNC_TMP_SUFFIX);
+
+	return len > slen &&
+	       !strcmp(name + len - slen, RAMFS_SYNC_TMP_SUFFIX);
+}
+
+/*
+ * 创建单层目录，已经存在时返回 -EEXIST。
+ * src 非空时新目录沿用它的权限位和属主，见 ramfs_restore_attrs。
+ */
+static int ramfs_mkdir_path(const char *path, umode_t mode,
+			    const struct inode *src)
+{
+	struct path parent;
+	struct dentry *dentry;
+	int err;
+
+	dentry = kern_path_create(AT_FDCWD, path, &parent, LOOKUP_DIRECTORY);
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
+	err = vfs_mkdir(&init_user_ns, d_inode(parent.dentry), dentry,
+			src ? 0700 : mode);
+	if (!err && src)
+		ramfs_restore_attrs(d_inode(dentry), src);
+	done_path_create(&parent, dentry);
+	return err;
+}
+
+static int ramfs_restore_actor(const char *rel, unsigned int type, void *arg)
+{
+	struct ramfs_restore_ctx *ctx = arg;
+	struct path src_path;
+	char *path;
+	int err;
+
+	if (type == DT_REG) {
+		// 上次 ramfs_sync_tree 中断时留下的临时文件
+		if (ramfs_is_tmp_name(rel))
+			return 0;
+		return ramfs_restore_file(ctx, rel);
+	}
+	if (type != DT_DIR)
+		return 0;
+
+	path = kasprintf(GFP_KERNEL, "%s/%s", ctx->src_root, rel);
+	if (!path)
+		return -ENOMEM;
+	err = kern_path(path, 0, &src_path);
+	kfree(path);
+	if (err)
+		return err;
+
+	path = kasprintf(GFP_KERNEL, "%s/%s", ctx->dst_root, rel);
+	if (!path) {
+		path_put(&src_path);
+		return -ENOMEM;
+	}
+	err = ramfs_mkdir_path(path, 0755, d_inode(src_path.dentry));
+	kfree(path);
+	path_put(&src_path);
+	return err == -EEXIST ? 0 : err;
+}
+
+/*
+ * 从绑定的 sync 目录恢复 ramfs 目录树，dir_path 对应
+ * sync 目录下同名的子树。目录结构由调用者线程建立，
+ * 文件内容在无绑定的写回队列上并行载入，返回前等待全部完成；
+ * 带 RAMFS_RESTORE_LAZY 时只建目录树，内容在第一次 open 时载入。
+ */
+SYSCALL_DEFINE2(ramfs_restore, const char __user *, dir_path,
+		unsigned int, flags)
+{
+	struct ramfs_restore_ctx ctx = {
+		.flags = flags,
+		.pending = ATOMIC_INIT(1),
+	};
+	struct path sync_dir_local, target;
+	char *kbuf, *src_root, *dst_buf, *dst_root;
+	int err;
+
+	if (flags & ~RAMFS_RESTORE_LAZY)
+		return -EINVAL;
+
+	kbuf = strndup_user(dir_path, PATH_MAX);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+	err = kern_path(kbuf, LOOKUP_FOLLOW | LOOKUP_DIRECTORY, &target);
+	kfree(kbuf);
+	if (err)
+		return err;
+
+	err = -EINVAL;
+	if (strcmp(target.dentry->d_sb->s_type->name, "ramfs") != 0)
+		goto out_target;
+	err = -ENOENT;
+	if (!ramfs_get_sync_dir(&sync_dir_local))
+		goto out_target;
+
+	src_root = ramfs_target_path(&sync_dir_local, target.dentry);
+	if (IS_ERR(src_root)) {
+		err = PTR_ERR(src_root);
+		goto out_sync_dir;
+	}
+	err = -ENOMEM;
+	dst_buf = __getname();
+	if (!dst_buf)
+		goto out_src_root;
+	dst_root = d_path(&target, dst_buf, PATH_MAX);
+	if (IS_ERR(dst_root)) {
+		err = PTR_ERR(dst_root);
+		goto out_dst_buf;
+	}
+
+	ctx.src_root = src_root;
+	ctx.dst_root = dst_root;
+	ctx.cred = current_cred();
+	init_completion(&ctx.done);
+	pr_info("ramfs_restore: %s -> %s\n", src_root, dst_root);
+
+	err = ramfs_walk_tree(src_root, ramfs_restore_actor, &ctx);
+
+	// 已经排队的载入工作引用了 ctx，无论成功与否都要等它们结束
+	if (!atomic_dec_and_test(&ctx.pending))
+		wait_for_completion(&ctx.done);
+	if (!err)
+		err = ctx.err;
+
+out_dst_buf:
+	__putname(dst_buf);
+out_src_root:
+	__putname(src_root);
+out_sync_dir:
+	path_put(&sync_dir_local);
+out_target:
+	path_put(&target);
+	return err;
+}
+
+/*
+ * ramfs_sync_tree：一次同步整棵目录树。
+ * 每个变化过的文件先完整写到同目录下的临时文件并发起写回，
+ * 攒够一批后统一 fsync、再逐个 rename 到目标位置，
+ * 最后对每个涉及的目标目录各做一次 fsync。
+ * 崩溃时目标位置要么是旧文件，要么是完整的新文件。
+ */
+#define RAMFS_SYNC_TREE_BATCH 256
+
+struct ramfs_tree_file {
+	struct list_head list;
+	struct ramfs_persist_inode *pi;
+	struct inode *inode;
+	struct file *tmp;
+	loff_t size;
+	char *dir;      /* 目标文件所在目录 */
+	char *name;     /* 目标文件名，指向 dir 同一块内存 */
+	char *tmp_name;
+};
+
+struct ramfs_tree_dir {
+	struct list_head list;
+	char path[];
+};
+
+struct ramfs_tree_ctx {
+	const char *src_root;   /* ramfs 中的目录 */
+	const char *dst_root;   /* sync 目录中对应的目录 */
+	struct path sync_dir;
+	struct list_head files;
+	unsigned int nr_files;
+	struct list_head dirs;
+};
+
+// 记录需要 fsync 的目标目录；遍历按目录进行，同一目录的记录总是相邻
+static int ramfs_tree_add_dir(struct ramfs_tree_ctx *ctx, const char *dir,
+			      size_t len)
+{
+	struct ramfs_tree_dir *d;
+
+	if (!list_empty(&ctx->dirs)) {
+		d = list_last_entry(&ctx->dirs, struct ramfs_tree_dir, list);
+		if (strlen(d->path) == len && !memcmp(d->path, dir, len))
+			return 0;
+	}
+	d = kmalloc(sizeof(*d) + len + 1, GFP_KERNEL);
+	if (!d)
+		return -ENOMEM;
+	memcpy(d->path, dir, len);
+	d->path[len] = '\0';
+	list_add_tail(&d->list, &ctx->dirs);
+	return 0;
+}
+
+static int ramfs_rename_in_dir(const char *dir_path, const char *old_name,
+			       const char *new_name)
+{
+	struct renamedata rd = {};
+	struct dentry *old, *new;
+	struct path dir;
+	int err;
+
+	err = kern_path(dir_path, LOOKUP_DIRECTORY, &dir);
+	if (err)
+		return err;
+	err = mnt_want_write(dir.mnt);
+	if (err)
+		goto out_path;
+
+	lock_rename(dir.dentry, dir.dentry);
+	old = lookup_one_len(old_name, dir.dentry, strlen(old_name));
+	if (IS_ERR(old)) {
+		err = PTR_ERR(old);
+		goto out_unlock;
+	}
+	err = -ENOENT;
+	if (d_is_negative(old))
+		goto out_old;
+	new = lookup_one_len(new_name, dir.dentry, strlen(new_name));
+	if (IS_ERR(new)) {
+		err = PTR_ERR(new);
+		goto out_old;
+	}
+
+	rd.old_mnt_userns = &init_user_ns;
+	rd.old_dir = d_inode(dir.dentry);
+	rd.old_dentry = old;
+	rd.new_mnt_userns = &init_user_ns;
+	rd.new_dir = d_inode(dir.dentry);
+	rd.new_dentry = new;
+	err = vfs_rename(&rd);
+
+	dput(new);
+out_old:
+	dput(old);
+out_unlock:
+	unlock_rename(dir.dentry, dir.dentry);
+	mnt_drop_write(dir.mnt);
+out_path:
+	path_put(&dir);
+	return err;
+}
+
+static void ramfs_tree_file_free(struct ramfs_tree_file *tf)
+{
+	if (tf->tmp)
+		filp_close(tf->tmp, NULL);
+	iput(tf->inode);
+	__putname(tf->dir);
+	kfree(tf->tmp_name);
+	kfree(tf);
+}
+
+/*
+ * 把一个文件完整拷贝到临时文件，并立即发起写回，
+ * 让这一批文件的 I/O 重叠进行，之后统一 fsync。
+ */
+static int ramfs_tree_stage(struct ramfs_tree_ctx *ctx, struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+	struct ramfs_persist_inode *pi;
+	struct ramfs_tree_file *tf;
+	char *slash, *tmp_path;
+	bool clean;
+	int err;
+
+	pi = ramfs_persist_inode(inode, true);
+	if (!pi)
+		return -ENOMEM;
+
+	mutex_lock(&pi->sync_lock);
+	spin_lock(&pi->dirty_lock);
+	clean = pi->synced && !pi->nr_ranges && !pi->mmap_dirty &&
+		!mapping_writably_mapped(inode->i_mapping) &&
+		pi->synced_size == i_size_read(inode);
+	spin_unlock(&pi->dirty_lock);
+	// 没有变化，或者内容还没从 sync 目录载入
+	if (clean || pi->hydrate_src.dentry) {
+		mutex_unlock(&pi->sync_lock);
+		return 0;
+	}
+
+	err = -ENOMEM;
+	tf = kzalloc(sizeof(*tf), GFP_KERNEL);
+	if (!tf)
+		goto out_unlock;
+	tf->pi = pi;
+	tf->inode = igrab(inode);
+
+	tf->dir = ramfs_target_path(&ctx->sync_dir, dentry);
+	if (IS_ERR(tf->dir)) {
+		err = PTR_ERR(tf->dir);
+		tf->dir = NULL;
+		goto out_free;
+	}
+	slash = strrchr(tf->dir, '/');
+	tf->tmp_name = kasprintf(GFP_KERNEL, "%s%s", slash + 1,
+				 RAMFS_SYNC_TMP_SUFFIX);
+	tmp_path = kasprintf(GFP_KERNEL, "%s%s", tf->dir,
+			     RAMFS_SYNC_TMP_SUFFIX);
+	if (!tf->tmp_name || !tmp_path) {
+		kfree(tmp_path);
+		goto out_free;
+	}
+	*slash = '\0';
+	tf->name = slash + 1;
+
+	tf->tmp = filp_open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+			    inode->i_mode & S_IRWXUGO);
+	kfree(tmp_path);
+	if (IS_ERR(tf->tmp)) {
+		err = PTR_ERR(tf->tmp);
+		tf->tmp = NULL;
+		pr_err("ramfs_sync_tree: open tmp failed: %d\n", err);
+		goto out_free;
+	}
+
+	// 临时文件总是完整拷贝，这之前的脏区间都已包含在内
+	spin_lock(&pi->dirty_lock);
+	pi->nr_ranges = 0;
+	if (!mapping_writably_mapped(inode->i_mapping))
+		pi->mmap_dirty = false;
+	tf->size = i_size_read(inode);
+	spin_unlock(&pi->dirty_lock);
+
+	err = ramfs_copy_range(inode, tf->tmp, 0, tf->size);
+	if (!err)
+		err = filemap_fdatawrite(tf->tmp->f_mapping);
+	if (err) {
+		pr_err("ramfs_sync_tree: write tmp failed: %d\n", err);
+		spin_lock(&pi->dirty_lock);
+		pi->synced = false;
+		spin_unlock(&pi->dirty_lock);
+		goto out_free;
+	}
+	// 从这里到 ramfs_tree_commit 中 rename 完成，单文件同步不能改写目标文件
+	pi->tree_pending = true;
+	mutex_unlock(&pi->sync_lock);
+
+	err = ramfs_tree_add_dir(ctx, tf->dir, strlen(tf->dir));
+	list_add_tail(&tf->list, &ctx->files);
+	ctx->nr_files++;
+	return err;
+
+out_free:
+	// 留下的临时文件不影响目标文件，下次同步会截断重用
+	ramfs_tree_file_free(tf);
+out_unlock:
+	mutex_unlock(&pi->sync_lock);
+	return err;
+}
+
+/*
+ * 提交一批临时文件：先全部 fsync，再逐个 rename 到目标位置。
+ * 任何一步失败的文件都会在下一次同步时完整重写。
+ */
+static int ramfs_tree_commit(struct ramfs_tree_ctx *ctx)
+{
+	struct ramfs_tree_file *tf, *tmp;
+	int err = 0, ret;
+
+	list_for_each_entry(tf, &ctx->files, list) {
+		ret = vfs_fsync(tf->tmp, 0);
+		filp_close(tf->tmp, NULL);
+		tf->tmp = NULL;
+		if (ret) {
+			pr_err("ramfs_sync_tree: fsync tmp failed: %d\n", ret);
+			tf->size = -1;
+			err = err ? err : ret;
+		}
+	}
+
+	list_for_each_entry_safe(tf, tmp, &ctx->files, list) {
+		ret = tf->size < 0 ? -EIO :
+		      ramfs_rename_in_dir(tf->dir, tf->tmp_name, tf->name);
+		if (ret && tf->size >= 0) {
+			pr_err("ramfs_sync_tree: rename failed: %d\n", ret);
+			err = err ? err : ret;
+		}
+
+		mutex_lock(&tf->pi->sync_lock);
+		spin_lock(&tf->pi->dirty_lock);
+		if (ret) {
+			tf->pi->synced = false;
+		} else {
+			tf->pi->synced = true;
+			tf->pi->synced_size = tf->size;
+		}
+		spin_unlock(&tf->pi->dirty_lock);
+		WRITE_ONCE(tf->pi->tree_pending, false);
+		mutex_unlock(&tf->pi->sync_lock);
+
+		list_del(&tf->list);
+		ramfs_tree_file_free(tf);
+	}
+	ctx->nr_files = 0;
+	wake_up_all(&ramfs_tree_wait);
+	return err;
+}
+
+static int ramfs_tree_actor(const char *rel, unsigned int type, void *arg)
+{
+	struct ramfs_tree_ctx *ctx = arg;
+	struct path path;
+	char *full, *slash;
+	int err;
+
+	if (type == DT_DIR) {
+		// sync 目录中还没有对应的子目录时建出来，并记下父目录等待 fsync
+		full = kasprintf(GFP_KERNEL, "%s/%s", ctx->dst_root, rel);
+		if (!full)
+			return -ENOMEM;
+		err = ramfs_mkdir_path(full, 0755, NULL);
+		if (!err) {
+			slash = strrchr(full, '/');
+			err = ramfs_tree_add_dir(ctx, full, slash - full);
+		} else if (err == -EEXIST) {
+			err = 0;
+		}
+		kfree(full);
+		return err;
+	}
+	if (type != DT_REG)
+		return 0;
+
+	full = kasprintf(GFP_KERNEL, "%s/%s", ctx->src_root, rel);
+	if (!full)
+		return -ENOMEM;
+	err = kern_path(full, 0, &path);
+	kfree(full);
+	if (err)
+		return err == -ENOENT ? 0 : err;   // 遍历期间被删除
+
+	err = ramfs_tree_stage(ctx, path.dentry);
+	path_put(&path);
+	if (!err && ctx->nr_files >= RAMFS_SYNC_TREE_BATCH)
+		err = ramfs_tree_commit(ctx);
+	return err;
+}
+
+// 同步 dirfd 下所有变化过的文件，调用者每个检查点只需一次系统调用
+SYSCALL_DEFINE1(ramfs_sync_tree, int, dirfd)
+{
+	struct ramfs_tree_ctx ctx = {
+		.files = LIST_HEAD_INIT(ctx.files),
+		.dirs = LIST_HEAD_INIT(ctx.dirs),
+	};
+	struct ramfs_tree_dir *d, *tmp;
+	struct file *dir;
+	char *src_buf, *dst_root;
+	struct fd f;
+	int err, ret;
+
+	f = fdget(dirfd);
+	if (!f.file)
+		return -EBADF;
+	err = -ENOTDIR;
+	if (!d_is_dir(f.file->f_path.dentry))
+		goto out_fd;
+	err = -EINVAL;
+	if (strcmp(file_inode(f.file)->i_sb->s_type->name, "ramfs") != 0)
+		goto out_fd;
+	err = -ENOENT;
+	if (!ramfs_get_sync_dir(&ctx.sync_dir))
+		goto out_fd;
+
+	dst_root = ramfs_target_path(&ctx.sync_dir, f.file->f_path.dentry);
+	if (IS_ERR(dst_root)) {
+		err = PTR_ERR(dst_root);
+		goto out_sync_dir;
+	}
+	err = -ENOMEM;
+	src_buf = __getname();
+	if (!src_buf)
+		goto out_dst_root;
+	ctx.src_root = d_path(&f.file->f_path, src_buf, PATH_MAX);
+	if (IS_ERR(ctx.src_root)) {
+		err = PTR_ERR(ctx.src_root);
+		goto out_src_buf;
+	}
+	ctx.dst_root = dst_root;
+
+	mutex_lock(&ramfs_tree_mutex);
+	err = ramfs_mkdir_path(dst_root, 0755, NULL);
+	if (err == -EEXIST)
+		err = 0;
+	if (!err)
+		err = ramfs_walk_tree(ctx.src_root, ramfs_tree_actor, &ctx);
+	ret = ramfs_tree_commit(&ctx);
+	if (!err)
+		err = ret;
+
+	// 每个涉及的目标目录只 fsync 一次，让 rename 和新建的目录落盘
+	list_for_each_entry_safe(d, tmp, &ctx.dirs, list) {
+		dir = filp_open(d->path, O_RDONLY | O_DIRECTORY, 0);
+		if (IS_ERR(dir)) {
+			ret = PTR_ERR(dir);
+		} else {
+			ret = vfs_fsync(dir, 0);
+			filp_close(dir, NULL);
+		}
+		if (ret && !err)
+			err = ret;
+		list_del(&d->list);
+		kfree(d);
+	}
+	mutex_unlock(&ramfs_tree_mutex);
+
+out_src_buf:
+	__putname(src_buf);
+out_dst_root:
+	__putname(dst_root);
+out_sync_dir:
+	path_put(&ctx.sync_dir);
+out_fd:
+	fdput(f);
+	return err;
+}
+
+static int __init ramfs_persist_init(void)
+{
+	ramfs_writeback_wq = alloc_workqueue("ramfs_writeback",
+					     WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!ramfs_writeback_wq)
+		pr_warn("ramfs_sync: no writeback workqueue, syncing inline\n");
+	return 0;
+}
+fs_initcall(ramfs_persist_init);
\ No newline at end of file
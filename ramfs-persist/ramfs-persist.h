@@ -3,20 +3,97 @@
 
 #include <linux/fs.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/path.h>
+#include <linux/workqueue.h>
 
+/*
+ * 全局绑定信息。lock 只保护 sync_dir/sync_bound，
+ * 不能在持有它的情况下做任何可能睡眠的 I/O。
+ */
 struct ramfs_persist_info {
   struct path sync_dir;
   bool   sync_bound;
   spinlock_t lock;
+  /* 非 0 时 flush/release 只把 inode 挂到写回队列，延迟这么多毫秒后同步 */
+  unsigned int writeback_delay_ms;
 };
 
+#define RAMFS_PERSIST_MAX_RANGES 8
+
+struct ramfs_dirty_range {
+  loff_t start;
+  loff_t end;
+};
+
+/*
+ * 每个 ramfs inode 的同步状态，挂在 inode->i_private 上，
+ * 在第一次写入时分配，由 ramfs_persist_evict_inode 释放。
+ */
+struct ramfs_persist_inode {
+  struct mutex sync_lock;  /* 串行化同一 inode 的同步，拷贝期间持有 */
+  spinlock_t dirty_lock;   /* 保护下面的脏区间和同步状态 */
+  /* 按 start 有序且互不重叠的脏区间，多留一个位置用于插入后合并 */
+  struct ramfs_dirty_range ranges[RAMFS_PERSIST_MAX_RANGES + 1];
+  unsigned int nr_ranges;
+  bool   mmap_dirty;   /* 曾被可写共享映射，无法精确追踪，需整体同步；映射期间一直保持 */
+  bool   synced;       /* 自载入内存后是否已完整同步过一次 */
+  loff_t synced_size;  /* 上次同步完成时的文件大小 */
+  bool   tree_pending; /* ramfs_sync_tree 已写好临时文件、尚未 rename，受 sync_lock 保护 */
+  /*
+   * 异步写回：同一 inode 的多次请求合并为一次，wb_dentry 非空表示已排队，
+   * 此时 pi 挂在全局的待写回链表上。只持有 dentry 不持有挂载，不妨碍 umount，
+   * 卸载前由 ramfs_persist_kill_sb 把该 sb 上排队的写回做完。
+   * wb_dentry 和 wb_list 由 ramfs_wb_lock 保护。
+   */
+  struct delayed_work wb_work;
+  struct dentry *wb_dentry;
+  struct list_head wb_list;
+  /*
+   * ramfs_restore：hydrate_src 非空表示内容还没从 sync 目录载入，
+   * 在写回队列上后台载入，或在第一次 open 时载入。
+   */
+  struct inode *inode;
+  struct work_struct hydrate_work;
+  struct path hydrate_src;
+  const struct cred *hydrate_cred;  /* 打开 hydrate_src 时使用的凭据，与它同时释放 */
+  struct ramfs_restore_ctx *hydrate_ctx;
+};
+
+/* ramfs_sync_tree 写临时文件时使用的后缀，ramfs_restore 会跳过这类残留文件 */
+#define RAMFS_SYNC_TMP_SUFFIX ".ramfs-tmp"
+
+/* ramfs_restore 的 flags：只建立目录树，文件内容推迟到第一次 open 时载入 */
+#define RAMFS_RESTORE_LAZY 0x1
+
 int ramfs_file_fsync(struct file *file, loff_t start, loff_t end, int datasync);
 
 int ramfs_file_flush(struct file *file, fl_owner_t id);
 
 int ramfs_file_release(struct inode *inode, struct file *file);
 
+/*
+ * 以下钩子需要接入 ramfs 本身：
+ *   ramfs_file_operations.open       = ramfs_file_open
+ *   ramfs_file_operations.write_iter = ramfs_file_write_iter
+ *   ramfs_file_operations.mmap       = ramfs_file_mmap
+ *   ramfs_file_inode_operations.setattr = ramfs_persist_setattr
+ *   ramfs_ops.evict_inode            = ramfs_persist_evict_inode
+ *   ramfs_kill_sb 开头调用 ramfs_persist_kill_sb(sb)，在 kill_litter_super 之前
+ */
+int ramfs_file_open(struct inode *inode, struct file *file);
+
+ssize_t ramfs_file_write_iter(struct kiocb *iocb, struct iov_iter *from);
+
+int ramfs_file_mmap(struct file *file, struct vm_area_struct *vma);
+
+int ramfs_persist_setattr(struct user_namespace *mnt_userns,
+			  struct dentry *dentry, struct iattr *ia);
+
+void ramfs_persist_evict_inode(struct inode *inode);
+
+void ramfs_persist_kill_sb(struct super_block *sb);
+
 extern struct ramfs_persist_info ramfs_persist_ops;
 
 #define RAMFS_PI(sb) ((struct ramfs_persist_info *)(sb)->s_fs_info)
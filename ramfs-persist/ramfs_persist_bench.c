@@ -0,0 +1,237 @@
+/*
+ * ramfs 同步的多线程吞吐量测试。
+ *
+ * 每个线程在 ramfs 目录下写自己的文件，每次改写一块数据后 fsync，
+ * fsync 走 ramfs_file_fsync 把脏区间同步到 sync 目录。线程数从 1 翻倍到 -t 指定的上限，
+ * 每种线程数报告每秒完成的同步次数；不同文件的同步不共享锁，吞吐量应随核数增长。
+ *
+ * 加 -T 时另起一个线程不停地对整个目录调用 ramfs_sync_tree，
+ * 用来观察整树同步期间单文件同步是否还能继续进行。
+ *
+ * 系统调用号取决于内核把 ramfs_bind/ramfs_sync_tree 加在了哪里，由命令行给出；
+ * 不加 -b 时假定 sync 目录已经绑定好。
+ *
+ * 编译：gcc -O2 -pthread -o ramfs_persist_bench ramfs_persist_bench.c
+ * 运行：mount -t ramfs none /mnt/ram
+ *       ./ramfs_persist_bench -b <__NR_ramfs_bind> -d /data/sync -T <__NR_ramfs_sync_tree> /mnt/ram
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct bench_opts {
+  const char *ram_dir;
+  unsigned int max_threads;
+  unsigned int iterations;     // 每个线程的同步次数
+  size_t block_size;           // 每次改写的字节数
+  size_t file_size;            // 每个文件的大小，改写位置在其中轮转
+  long nr_sync_tree;           // ramfs_sync_tree 的系统调用号，-1 表示不测
+};
+
+struct bench_thread {
+  pthread_t tid;
+  const struct bench_opts *opts;
+  pthread_barrier_t *start;
+  unsigned int index;
+  uint64_t max_ns;             // 单次 pwrite+fsync 的最长耗时
+  int err;
+};
+
+static volatile int tree_stop;
+static uint64_t tree_calls;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void *bench_worker(void *arg)
+{
+  struct bench_thread *t = arg;
+  const struct bench_opts *o = t->opts;
+  char path[4096];
+  char *block;
+  off_t off = 0;
+  uint64_t t0, dt;
+  unsigned int i;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/bench.%u", o->ram_dir, t->index);
+  block = malloc(o->block_size);
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (block == NULL || fd < 0) {
+    t->err = errno ? errno : ENOMEM;
+    pthread_barrier_wait(t->start);
+    free(block);
+    return NULL;
+  }
+  memset(block, 'a' + t->index % 26, o->block_size);
+  // 先完整同步一次，之后每次只有一个脏区间
+  if (ftruncate(fd, o->file_size) < 0 || fsync(fd) < 0)
+    t->err = errno;
+
+  pthread_barrier_wait(t->start);
+  for (i = 0; i < o->iterations && !t->err; i++) {
+    t0 = now_ns();
+    if (pwrite(fd, block, o->block_size, off) != (ssize_t)o->block_size ||
+        fsync(fd) < 0) {
+      t->err = errno;
+      break;
+    }
+    dt = now_ns() - t0;
+    if (dt > t->max_ns)
+      t->max_ns = dt;
+    off += o->block_size;
+    if (off + o->block_size > o->file_size)
+      off = 0;
+  }
+
+  close(fd);
+  unlink(path);
+  free(block);
+  return NULL;
+}
+
+static void *tree_worker(void *arg)
+{
+  const struct bench_opts *o = arg;
+  int dirfd = open(o->ram_dir, O_RDONLY | O_DIRECTORY);
+
+  if (dirfd < 0)
+    return NULL;
+  while (!tree_stop) {
+    if (syscall(o->nr_sync_tree, dirfd) < 0) {
+      perror("ramfs_sync_tree");
+      break;
+    }
+    __atomic_fetch_add(&tree_calls, 1, __ATOMIC_RELAXED);
+  }
+  close(dirfd);
+  return NULL;
+}
+
+static int run_round(const struct bench_opts *o, unsigned int nr_threads)
+{
+  struct bench_thread *threads;
+  pthread_barrier_t start;
+  pthread_t tree_tid;
+  uint64_t t0, elapsed, max_ns = 0, syncs;
+  unsigned int i;
+  int err = 0;
+
+  threads = calloc(nr_threads, sizeof(*threads));
+  if (threads == NULL)
+    return ENOMEM;
+  pthread_barrier_init(&start, NULL, nr_threads + 1);
+  for (i = 0; i < nr_threads; i++) {
+    threads[i].opts = o;
+    threads[i].start = &start;
+    threads[i].index = i;
+    pthread_create(&threads[i].tid, NULL, bench_worker, &threads[i]);
+  }
+
+  tree_stop = 0;
+  tree_calls = 0;
+  pthread_barrier_wait(&start);
+  t0 = now_ns();
+  if (o->nr_sync_tree >= 0)
+    pthread_create(&tree_tid, NULL, tree_worker, (void *)o);
+  for (i = 0; i < nr_threads; i++) {
+    pthread_join(threads[i].tid, NULL);
+    if (threads[i].err && !err)
+      err = threads[i].err;
+    if (threads[i].max_ns > max_ns)
+      max_ns = threads[i].max_ns;
+  }
+  elapsed = now_ns() - t0;
+  tree_stop = 1;
+  if (o->nr_sync_tree >= 0)
+    pthread_join(tree_tid, NULL);
+  pthread_barrier_destroy(&start);
+  free(threads);
+
+  if (err) {
+    fprintf(stderr, "%u threads: %s\n", nr_threads, strerror(err));
+    return err;
+  }
+  syncs = (uint64_t)nr_threads * o->iterations;
+  printf("%7u %12.0f %12.0f %10.3f", nr_threads,
+         syncs * 1e9 / elapsed, syncs * 1e9 / elapsed / nr_threads, max_ns / 1e6);
+  if (o->nr_sync_tree >= 0)
+    printf(" %10llu", (unsigned long long)tree_calls);
+  printf("\n");
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-b nr_ramfs_bind -d sync_dir] [-T nr_ramfs_sync_tree]\n"
+          "          [-t max_threads] [-n iterations] [-s block_size] [-f file_size] ramfs_dir\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  struct bench_opts o = {
+    .max_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN),
+    .iterations = 2000,
+    .block_size = 4096,
+    .file_size = 1 << 20,
+    .nr_sync_tree = -1,
+  };
+  const char *sync_dir = NULL;
+  long nr_bind = -1;
+  unsigned int n;
+  int c;
+
+  while ((c = getopt(argc, argv, "b:d:T:t:n:s:f:")) != -1) {
+    switch (c) {
+    case 'b': nr_bind = strtol(optarg, NULL, 0); break;
+    case 'd': sync_dir = optarg; break;
+    case 'T': o.nr_sync_tree = strtol(optarg, NULL, 0); break;
+    case 't': o.max_threads = strtoul(optarg, NULL, 0); break;
+    case 'n': o.iterations = strtoul(optarg, NULL, 0); break;
+    case 's': o.block_size = strtoul(optarg, NULL, 0); break;
+    case 'f': o.file_size = strtoul(optarg, NULL, 0); break;
+    default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind + 1 != argc || (nr_bind >= 0) != (sync_dir != NULL) ||
+      o.max_threads == 0 || o.block_size == 0 || o.block_size > o.file_size) {
+    usage(argv[0]);
+    return 2;
+  }
+  o.ram_dir = argv[optind];
+
+  if (nr_bind >= 0 && syscall(nr_bind, sync_dir) < 0) {
+    perror("ramfs_bind");
+    return 1;
+  }
+
+  printf("%u syncs of %zu bytes per thread, file size %zu\n",
+         o.iterations, o.block_size, o.file_size);
+  printf("%7s %12s %12s %10s%s\n", "threads", "syncs/s", "per-thread", "max ms",
+         o.nr_sync_tree >= 0 ? "  tree syncs" : "");
+  for (n = 1; ; n *= 2) {
+    if (n > o.max_threads)
+      n = o.max_threads;
+    if (run_round(&o, n))
+      return 1;
+    if (n == o.max_threads)
+      break;
+  }
+  return 0;
+}
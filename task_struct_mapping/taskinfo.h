@@ -1,14 +1,61 @@
 #ifndef __VDSO_TASKINFO_H
 #define __VDSO_TASKINFO_H
 
-#include <linux/seqlock.h>
+#include <linux/threads.h>
+#include <linux/kernel.h>
+#include <linux/compiler.h>
+#include <linux/jump_label.h>
+#include <asm/barrier.h>
+#include <asm/page.h>
 #include <uapi/linux/vsdo_taskinfo.h>
 
+/*
+ * seq 用裸 u32 而不是 seqcount_t：后者在 CONFIG_DEBUG_LOCK_ALLOC 下带着 lockdep map，
+ * 会撑大槽、改变用户态看到的布局。每个槽只有所在 CPU 自己写（关抢占），
+ * 不需要写者之间的互斥，只要 smp_wmb 保证读者看到的顺序。
+ */
 struct vdso_taskinfo_percpu {
-        seqcount_t seq;
+        u32 seq;
+        u32 magic;      /* VDSO_TASKINFO_MAGIC，开机时写入后不再改变 */
         struct vdso_taskinfo ti;
 } ____cacheline_aligned;
 
-static struct vdso_taskinfo_percpu __percpu *vdso_ti;
+static __always_inline void vdso_taskinfo_write_begin(struct vdso_taskinfo_percpu *d)
+{
+        WRITE_ONCE(d->seq, d->seq + 1);
+        smp_wmb();
+}
 
-#endif
\ No newline at end of file
+static __always_inline void vdso_taskinfo_write_end(struct vdso_taskinfo_percpu *d)
+{
+        smp_wmb();
+        WRITE_ONCE(d->seq, d->seq + 1);
+}
+
+/*
+ * 所有 CPU 的槽放在一段页对齐的连续内存里，按 CPU 编号索引，
+ * 整段映射进用户态，用户态用 sched_getcpu() 的结果找到自己的槽。
+ *
+ * vvar 里按 NR_CPUS 预留的只是地址范围，缺页时才填页表；
+ * 槽本身在开机时按 nr_cpu_ids 分配，共 vdso_taskinfo_nr_pages 页，超出部分不会被映射。
+ */
+#define VDSO_TASKINFO_PAGES \
+        DIV_ROUND_UP(NR_CPUS * sizeof(struct vdso_taskinfo_percpu), PAGE_SIZE)
+
+extern struct vdso_taskinfo_percpu *vdso_ti;
+extern unsigned int vdso_taskinfo_nr_pages;
+
+static inline struct vdso_taskinfo_percpu *vdso_taskinfo_slot(int cpu)
+{
+        return &vdso_ti[cpu];
+}
+
+struct task_struct;
+
+/* 第一次有进程映射 taskinfo 页时打开，之前上下文切换完全不碰这些槽 */
+DECLARE_STATIC_KEY_FALSE(vdso_taskinfo_used);
+
+void update_vdso_taskinfo(struct task_struct *p, int cpu);
+void clear_vdso_taskinfo(int cpu);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * 上下文切换开销的 pipe 乒乓测试：两个进程绑在同一个 CPU 上，通过两根管道来回传一个字节，
+ * 每个来回两次切换，报告每次切换的平均耗时。依次测三种状态：
+ *
+ *   unused  没有任何进程映射过 taskinfo 页，static key 关闭，调度路径上只有一条 nop；
+ *           static key 打开后不会再关，所以只有开机后第一次运行时这一行才有意义
+ *   off     static key 已打开（由一个临时进程映射一次页面触发），乒乓双方都没有映射，
+ *           每次切换多一次 mm 标志位检查，必要时清空槽
+ *   on      乒乓双方都映射了页面，每次切换都更新槽
+ *
+ * 在没有 CONFIG_VDSO_TASKINFO 的内核上三行应当一致，可以作为基线。
+ *
+ * 编译：gcc -O2 -I<内核 uapi 头文件目录> -o taskinfo_csw_bench taskinfo_csw_bench.c
+ * 运行：./taskinfo_csw_bench [-c cpu] [-n 来回次数] [-r 重复次数] [unused|off|on ...]
+ */
+
+#include "taskinfo_user.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/wait.h>
+
+enum csw_mode { CSW_UNUSED, CSW_OFF, CSW_ON };
+
+static const char *const csw_mode_names[] = { "unused", "off", "on" };
+
+static __u64 csw_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (__u64)ts.tv_sec * 1000000000u + (__u64)ts.tv_nsec;
+}
+
+static int csw_pin(int cpu)
+{
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set);
+}
+
+// 映射 taskinfo 页并读一次，让内核为本进程打开 taskinfo
+static void csw_opt_in(void)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_init() == 0)
+    vdso_taskinfo_read(&ti);
+}
+
+// 在临时子进程里映射一次页面，打开 static key，本进程保持未映射
+static void csw_enable_key(void)
+{
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    csw_opt_in();
+    _exit(0);
+  }
+  if (pid > 0)
+    waitpid(pid, NULL, 0);
+}
+
+/*
+ * 运行一轮乒乓，返回每次切换的纳秒数，失败返回负数。
+ * 双方在 fork 之后各自映射页面，不依赖从父进程继承。
+ */
+static double csw_pingpong(int cpu, unsigned long rounds, int opt_in)
+{
+  int p2c[2], c2p[2];
+  unsigned long i;
+  char b = 0;
+  pid_t pid;
+  __u64 t0, t1;
+
+  if (pipe(p2c) < 0 || pipe(c2p) < 0)
+    return -1;
+  pid = fork();
+  if (pid < 0)
+    return -1;
+  if (pid == 0) {
+    csw_pin(cpu);
+    if (opt_in)
+      csw_opt_in();
+    for (i = 0; i < rounds + 1; i++) {
+      if (read(p2c[0], &b, 1) != 1 || write(c2p[1], &b, 1) != 1)
+        _exit(1);
+    }
+    _exit(0);
+  }
+
+  csw_pin(cpu);
+  if (opt_in)
+    csw_opt_in();
+  // 第一个来回用来等子进程就绪，不计时
+  if (write(p2c[1], &b, 1) != 1 || read(c2p[0], &b, 1) != 1)
+    return -1;
+  t0 = csw_now_ns();
+  for (i = 0; i < rounds; i++) {
+    if (write(p2c[1], &b, 1) != 1 || read(c2p[0], &b, 1) != 1)
+      return -1;
+  }
+  t1 = csw_now_ns();
+
+  waitpid(pid, NULL, 0);
+  close(p2c[0]);
+  close(p2c[1]);
+  close(c2p[0]);
+  close(c2p[1]);
+  return (double)(t1 - t0) / (double)(rounds * 2);
+}
+
+/*
+ * 在单独的子进程里跑一轮乒乓，映射页面的效果留在子进程里，
+ * 主进程始终保持未映射，模式的先后顺序不影响结果。
+ */
+static double csw_run_isolated(int cpu, unsigned long rounds, int opt_in)
+{
+  int res[2];
+  double ns = -1;
+  pid_t pid;
+
+  if (pipe(res) < 0)
+    return -1;
+  pid = fork();
+  if (pid < 0)
+    return -1;
+  if (pid == 0) {
+    close(res[0]);
+    ns = csw_pingpong(cpu, rounds, opt_in);
+    _exit(write(res[1], &ns, sizeof(ns)) == sizeof(ns) ? 0 : 1);
+  }
+  close(res[1]);
+  if (read(res[0], &ns, sizeof(ns)) != sizeof(ns))
+    ns = -1;
+  close(res[0]);
+  waitpid(pid, NULL, 0);
+  return ns;
+}
+
+static int csw_parse_mode(const char *s)
+{
+  int m;
+
+  for (m = CSW_UNUSED; m <= CSW_ON; m++) {
+    if (strcmp(s, csw_mode_names[m]) == 0)
+      return m;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv)
+{
+  int modes[3] = { CSW_UNUSED, CSW_OFF, CSW_ON };
+  int nr_modes = 3, cpu = 0, repeat = 5;
+  unsigned long rounds = 200000;
+  double ns, best;
+  int c, i, r;
+
+  while ((c = getopt(argc, argv, "c:n:r:")) != -1) {
+    switch (c) {
+    case 'c': cpu = atoi(optarg); break;
+    case 'n': rounds = strtoul(optarg, NULL, 0); break;
+    case 'r': repeat = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-c cpu] [-n rounds] [-r repeat] [unused|off|on ...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (optind < argc) {
+    for (nr_modes = 0; optind < argc && nr_modes < 3; optind++, nr_modes++) {
+      if ((modes[nr_modes] = csw_parse_mode(argv[optind])) < 0) {
+        fprintf(stderr, "unknown mode %s\n", argv[optind]);
+        return 2;
+      }
+    }
+  }
+
+  if (vdso_taskinfo_init() != 0)
+    printf("kernel has no vDSO taskinfo page: all modes measure the baseline\n");
+  printf("%-8s %12s %12s\n", "mode", "best ns/csw", "last ns/csw");
+  for (i = 0; i < nr_modes; i++) {
+    if (modes[i] == CSW_OFF)
+      csw_enable_key();
+    best = 0;
+    ns = 0;
+    for (r = 0; r < repeat; r++) {
+      if ((ns = csw_run_isolated(cpu, rounds, modes[i] == CSW_ON)) < 0) {
+        perror("pingpong");
+        return 1;
+      }
+      if (best == 0 || ns < best)
+        best = ns;
+    }
+    printf("%-8s %12.1f %12.1f\n", csw_mode_names[modes[i]], best, ns);
+  }
+  return 0;
+}
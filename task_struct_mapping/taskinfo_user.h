@@ -0,0 +1,302 @@
+#ifndef _VDSO_TASKINFO_USER_H
+#define _VDSO_TASKINFO_USER_H
+
+/*
+ * 用户态读取 vDSO taskinfo 页，代替 getpid/gettid/sched_getcpu/getrusage 等系统调用。
+ *
+ * 页的地址由 vDSO 导出的 __vdso_taskinfo_page() 给出，第一次使用时通过
+ * AT_SYSINFO_EHDR 解析 vDSO 的动态符号表找到它。每个 CPU 一个槽，读法是：
+ *   1. sched_getcpu()（本身走 vDSO）得到当前 CPU，找到对应的槽
+ *   2. 按 seqcount 读出需要的字段，seq 为奇数或前后不一致就重试
+ *   3. 再次 sched_getcpu()，仍是同一个 CPU 且 seq 不变，说明读的过程中没有被切走
+ *   4. 核对槽里的 pid 是不是当前线程（线程 id 每个线程只取一次，缓存在 TLS 里）
+ *
+ * 内核只为映射过 taskinfo 页的进程维护槽（第一次缺页时打开），线程要等下一次被调度进来
+ * 才有自己的数据，在那之前各个 getter 只退回到自己对应的那一个系统调用。
+ * 内核不支持，或者进程不在初始 pid 命名空间里（内核给的是零页，没有 magic）时，
+ * vdso_taskinfo_init 返回 -1，之后 getter 直接走系统调用，不再尝试读槽。
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/auxv.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/vsdo_taskinfo.h>
+
+struct vdso_taskinfo_slot {
+  volatile __u32 seq;
+  __u32 magic;
+  struct vdso_taskinfo ti;
+} __attribute__((aligned(VDSO_TASKINFO_SLOT_SIZE)));
+
+_Static_assert(sizeof(struct vdso_taskinfo_slot) == VDSO_TASKINFO_SLOT_SIZE, "taskinfo slot layout");
+
+static const struct vdso_taskinfo_slot *vdso_taskinfo_slots;
+
+/* 在 vDSO 的动态符号表里查找 name，找不到返回 NULL */
+static void *vdso_taskinfo_lookup(const char *name)
+{
+  const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)getauxval(AT_SYSINFO_EHDR);
+  const ElfW(Phdr) *phdr;
+  const ElfW(Dyn) *dyn = NULL;
+  const ElfW(Sym) *symtab = NULL;
+  const char *strtab = NULL;
+  const ElfW(Word) *hash = NULL;
+  uintptr_t load_offset = 0;
+  ElfW(Word) i, nsym;
+  int found_load = 0;
+
+  if (ehdr == NULL)
+    return NULL;
+
+  /* 1. 计算加载偏移，找到 PT_DYNAMIC */
+  phdr = (const ElfW(Phdr) *)((const char *)ehdr + ehdr->e_phoff);
+  for (i = 0; i < ehdr->e_phnum; i++) {
+    if (phdr[i].p_type == PT_LOAD && !found_load) {
+      load_offset = (uintptr_t)ehdr + phdr[i].p_offset - phdr[i].p_vaddr;
+      found_load = 1;
+    } else if (phdr[i].p_type == PT_DYNAMIC) {
+      dyn = (const ElfW(Dyn) *)((const char *)ehdr + phdr[i].p_offset);
+    }
+  }
+  if (!found_load || dyn == NULL)
+    return NULL;
+
+  /* 2. 从动态段取符号表、字符串表和哈希表（用来得到符号个数） */
+  for (; dyn->d_tag != DT_NULL; dyn++) {
+    if (dyn->d_tag == DT_SYMTAB)
+      symtab = (const ElfW(Sym) *)(dyn->d_un.d_ptr + load_offset);
+    else if (dyn->d_tag == DT_STRTAB)
+      strtab = (const char *)(dyn->d_un.d_ptr + load_offset);
+    else if (dyn->d_tag == DT_HASH)
+      hash = (const ElfW(Word) *)(dyn->d_un.d_ptr + load_offset);
+  }
+  if (symtab == NULL || strtab == NULL || hash == NULL)
+    return NULL;
+
+  /* 3. 符号不多，线性查找即可，只在初始化时做一次 */
+  nsym = hash[1];
+  for (i = 0; i < nsym; i++) {
+    if (ELF64_ST_TYPE(symtab[i].st_info) != STT_FUNC || symtab[i].st_shndx == SHN_UNDEF)
+      continue;
+    if (strcmp(strtab + symtab[i].st_name, name) == 0)
+      return (void *)(symtab[i].st_value + load_offset);
+  }
+  return NULL;
+}
+
+/* 当前线程的 tid，0 表示还没取过；fork 出的子进程里由 atfork 处理函数清零 */
+static __thread pid_t vdso_taskinfo_tid;
+
+static void vdso_taskinfo_atfork_child(void)
+{
+  vdso_taskinfo_tid = 0;
+}
+
+static inline pid_t vdso_taskinfo_self(void)
+{
+  if (vdso_taskinfo_tid == 0)
+    vdso_taskinfo_tid = (pid_t)syscall(SYS_gettid);
+  return vdso_taskinfo_tid;
+}
+
+/*
+ * 找到 taskinfo 页。成功返回 0；内核不支持、或者映射到的是零页（不在初始 pid 命名空间）
+ * 返回 -1，此后 getter 都直接走系统调用。可以重复调用
+ */
+static inline int vdso_taskinfo_init(void)
+{
+  const struct vdso_taskinfo_slot *slots;
+  const void *(*page)(void);
+
+  if (vdso_taskinfo_slots != NULL)
+    return 0;
+  if ((page = (const void *(*)(void))vdso_taskinfo_lookup("__vdso_taskinfo_page")) == NULL)
+    return -1;
+  slots = (const struct vdso_taskinfo_slot *)page();
+  // 第一次访问触发缺页，内核在这里决定给真正的槽还是零页
+  if (slots == NULL || __atomic_load_n(&slots[0].magic, __ATOMIC_RELAXED) != VDSO_TASKINFO_MAGIC)
+    return -1;
+  if (pthread_atfork(NULL, NULL, vdso_taskinfo_atfork_child) != 0)
+    return -1;
+  __atomic_store_n(&vdso_taskinfo_slots, slots, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static inline __u32 vdso_taskinfo_read_begin(const struct vdso_taskinfo_slot *s)
+{
+  __u32 seq;
+
+  while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  return seq;
+}
+
+static inline int vdso_taskinfo_read_retry(const struct vdso_taskinfo_slot *s, __u32 seq)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/* 以下几个是各个字段的系统调用版本，槽不可用时每个 getter 只调用自己需要的那一个 */
+
+static inline int vdso_taskinfo_sys_nice(void)
+{
+  int nice;
+
+  errno = 0;
+  nice = getpriority(PRIO_PROCESS, 0);
+  return errno == 0 ? nice : 0;
+}
+
+static inline void vdso_taskinfo_sys_rusage(struct vdso_taskinfo *out)
+{
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+    out->utime = (__u64)ru.ru_utime.tv_sec * 1000000000u + (__u64)ru.ru_utime.tv_usec * 1000u;
+    out->stime = (__u64)ru.ru_stime.tv_sec * 1000000000u + (__u64)ru.ru_stime.tv_usec * 1000u;
+    out->nvcsw = (__u64)ru.ru_nvcsw;
+    out->nivcsw = (__u64)ru.ru_nivcsw;
+  }
+}
+
+/*
+ * 完整 struct vdso_taskinfo 的系统调用版本，只给 vdso_taskinfo_read 用。
+ * prio 按普通调度策略换算成 120 + nice。
+ */
+static void vdso_taskinfo_read_slow(struct vdso_taskinfo *out)
+{
+  unsigned int cpu = 0, node = 0;
+
+  memset(out, 0, sizeof(*out));
+  out->pid = (__u32)vdso_taskinfo_self();
+  out->tgid = (__u32)getpid();
+  syscall(SYS_getcpu, &cpu, &node, NULL);
+  out->cpu = cpu;
+  out->numa_node = (__u16)node;
+  out->nice = (__s8)vdso_taskinfo_sys_nice();
+  out->prio = (__u8)(120 + out->nice);
+  vdso_taskinfo_sys_rusage(out);
+}
+
+/*
+ * 从槽里读出当前线程的 struct vdso_taskinfo，成功返回 0。
+ * 槽不可用、或者槽里还不是自己（线程还没被重新调度进来）返回 -1，out 的内容无意义。
+ * 失败时不发任何系统调用，tid 每个线程只取一次。
+ */
+static inline int vdso_taskinfo_try_read(struct vdso_taskinfo *out)
+{
+  const struct vdso_taskinfo_slot *s;
+  __u32 seq;
+  int cpu;
+
+  if (vdso_taskinfo_slots == NULL)
+    return -1;
+
+  do {
+    cpu = sched_getcpu();
+    s = &vdso_taskinfo_slots[cpu];
+    seq = vdso_taskinfo_read_begin(s);
+    memcpy(out, (const void *)&s->ti, sizeof(*out));
+  } while (vdso_taskinfo_read_retry(s, seq) || sched_getcpu() != cpu);
+
+  return (pid_t)out->pid == vdso_taskinfo_self() ? 0 : -1;
+}
+
+/* 读出当前线程的完整 struct vdso_taskinfo，槽不可用时退回系统调用 */
+static inline void vdso_taskinfo_read(struct vdso_taskinfo *out)
+{
+  if (vdso_taskinfo_try_read(out) != 0)
+    vdso_taskinfo_read_slow(out);
+}
+
+static inline pid_t vdso_gettid(void)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_try_read(&ti) == 0)
+    return (pid_t)ti.pid;
+  return (pid_t)syscall(SYS_gettid);
+}
+
+static inline pid_t vdso_getpid(void)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_try_read(&ti) == 0)
+    return (pid_t)ti.tgid;
+  return getpid();
+}
+
+/*
+ * 同时返回 CPU 和 NUMA 节点，参数可以为 NULL，与 getcpu(2) 一致。
+ * CPU 直接用 sched_getcpu() 的结果，节点在开机时写好、不随任务变化，
+ * 按 CPU 查槽即可，不需要 seq 和 pid 校验
+ */
+static inline int vdso_getcpu(unsigned int *cpu, unsigned int *node)
+{
+  const struct vdso_taskinfo_slot *slots = vdso_taskinfo_slots;
+  int c;
+
+  if (slots == NULL)
+    return getcpu(cpu, node);  // glibc 走内核 vDSO 里的 getcpu，不陷入内核
+  c = sched_getcpu();
+  if (cpu != NULL)
+    *cpu = (unsigned int)c;
+  if (node != NULL)
+    *node = slots[c].ti.numa_node;
+  return 0;
+}
+
+static inline void vdso_getprio(int *nice, int *prio)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_try_read(&ti) == 0) {
+    *nice = ti.nice;
+    *prio = ti.prio;
+    return;
+  }
+  *nice = vdso_taskinfo_sys_nice();
+  *prio = 120 + *nice;
+}
+
+/*
+ * 当前线程的用户态/内核态 CPU 时间（纳秒）。
+ * 取值时刻是本次被调度到 CPU 上的那一刻，不含本次时间片里已经运行的部分。
+ */
+static inline void vdso_getcputime(__u64 *utime, __u64 *stime)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_try_read(&ti) != 0)
+    vdso_taskinfo_sys_rusage(&ti);
+  *utime = ti.utime;
+  *stime = ti.stime;
+}
+
+static inline void vdso_getcsw(__u64 *nvcsw, __u64 *nivcsw)
+{
+  struct vdso_taskinfo ti;
+
+  if (vdso_taskinfo_try_read(&ti) != 0)
+    vdso_taskinfo_sys_rusage(&ti);
+  *nvcsw = ti.nvcsw;
+  *nivcsw = ti.nivcsw;
+}
+
+#endif
@@ -3,9 +3,34 @@
 
 #include <linux/types.h>
 
+/*
+ * 每个 CPU 一个槽，描述当前在该 CPU 上运行的任务，在切换到该任务时更新。
+ * 槽按 CPU 编号连续排列，每个槽占一个 cache line：
+ *   [__u32 seq][__u32 magic][struct vdso_taskinfo]
+ * seq 为奇数时表示正在写入，读者需要重试。magic 在开机时写入 VDSO_TASKINFO_MAGIC，
+ * 读到 0 说明映射到的是零页（见下），槽不可用。
+ *
+ * 整段映射对所有映射了它的进程可见，所以槽里只放 /proc/<pid>/stat 里本来就对所有用户
+ * 可读的字段，不放内核地址；而且只有自己映射过这段内存的任务才会被写进槽，
+ * CPU 切换到没有映射它的任务（包括内核线程）时槽被清空，pid 为 0。
+ *
+ * 槽里的 pid/tgid 是初始 pid 命名空间里的编号。不在初始命名空间里的任务（容器）
+ * 映射到的是零页，既看不到别的任务，也不会被写进槽，只能走系统调用。
+ */
+#define VDSO_TASKINFO_SLOT_SIZE 64
+#define VDSO_TASKINFO_MAGIC     0x54534b49u  /* "IKST" */
+
 struct vdso_taskinfo {
-  __u32 pid;        /* current->pid(as an example of the information in task_struct)              */
-  __u64 task_struct_ptr; /* pointer to task_struct   */
+  __u32 pid;        /* current->pid(as an example of the information in task_struct)，即线程 id，等于 gettid() */
+  __u32 tgid;       /* current->tgid，即进程 id，等于 getpid()                          */
+  __u64 utime;      /* 用户态 CPU 时间(ns)，取自切换进来的时刻                           */
+  __u64 stime;      /* 内核态 CPU 时间(ns)，同上                                        */
+  __u64 nvcsw;      /* 主动上下文切换次数                                               */
+  __u64 nivcsw;     /* 被动上下文切换次数                                               */
+  __u32 cpu;        /* 当前 CPU                                                        */
+  __u16 numa_node;  /* 当前 CPU 所在的 NUMA 节点                                        */
+  __s8  nice;       /* task_nice()，-20..19                                            */
+  __u8  prio;       /* current->prio，0..139                                           */
 };
 
 #endif
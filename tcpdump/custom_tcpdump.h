@@ -1,44 +1,101 @@
+#ifndef CUSTOM_TCPDUMP_H
+#define CUSTOM_TCPDUMP_H
+
 #include <pcap.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-int custom_tcpdump_capture(const char* iface, const char* custom_filter, void* buffer, size_t buffer_size) {
+/*
+ * 编译并设置过滤规则（如果提供了 custom_filter）。
+ * 失败时返回 -2（表达式错误）或 -3（无法设置），句柄由调用者关闭。
+ */
+int custom_tcpdump_set_filter(pcap_t *handle, const char* iface, const char* custom_filter) {
     char errbuf[PCAP_ERRBUF_SIZE];
-    pcap_t *handle;
     struct bpf_program bpf;
     bpf_u_int32 net = 0, mask = 0;
-    size_t offset = 0;
-    int snaplen = 65535;
-    int promisc = 1;
-    int timeout_ms = 1000;
 
-    // 1. 打开网络接口进行抓包
-    if ((handle = pcap_open_live(iface, snaplen, promisc, timeout_ms, errbuf)) == NULL) {
-        fprintf(stderr, "Error: cannot open device %s - %s\n", iface, errbuf);
-        return -1;
+    if (custom_filter == NULL || strlen(custom_filter) == 0) {
+        return 0;
     }
 
-    if (pcap_lookupnet(iface, &net, &mask, errbuf) == -1) {
+    if (iface != NULL && pcap_lookupnet(iface, &net, &mask, errbuf) == -1) {
         fprintf(stderr, "Warning: could not get netmask for device %s, %s\n", iface, errbuf);
         net = 0;
         mask = 0;
     }
 
-    // 2. 编译并设置过滤规则（如果提供了 custom_filter）
-    if (custom_filter != NULL && strlen(custom_filter) > 0) {
-        if (pcap_compile(handle, &bpf, custom_filter, 1, net) == -1) {
-            fprintf(stderr, "Error: bad filter \"%s\" - %s\n", custom_filter, pcap_geterr(handle));
-            pcap_close(handle);
-            return -2;
-        }
-        if (pcap_setfilter(handle, &bpf) == -1) {
-            fprintf(stderr, "Error: cannot set filter \"%s\" - %s\n", custom_filter, pcap_geterr(handle));
-            pcap_freecode(&bpf);
-            pcap_close(handle);
-            return -3;
-        }
+    if (pcap_compile(handle, &bpf, custom_filter, 1, net) == -1) {
+        fprintf(stderr, "Error: bad filter \"%s\" - %s\n", custom_filter, pcap_geterr(handle));
+        return -2;
+    }
+    if (pcap_setfilter(handle, &bpf) == -1) {
+        fprintf(stderr, "Error: cannot set filter \"%s\" - %s\n", custom_filter, pcap_geterr(handle));
         pcap_freecode(&bpf);
+        return -3;
+    }
+    pcap_freecode(&bpf);
+    return 0;
+}
+
+/*
+ * 回放抓包文件需要显式写成 "file:<路径>"，不按文件系统里是否存在同名文件猜测，
+ * 以免当前目录下恰好有一个与网卡同名的文件时把抓包变成回放。
+ */
+#define CUSTOM_TCPDUMP_SAVEFILE_PREFIX "file:"
+
+int custom_tcpdump_is_savefile(const char* iface) {
+    return iface != NULL &&
+           strncmp(iface, CUSTOM_TCPDUMP_SAVEFILE_PREFIX, sizeof(CUSTOM_TCPDUMP_SAVEFILE_PREFIX) - 1) == 0;
+}
+
+// "file:<路径>" 中的路径部分，调用前需确认 custom_tcpdump_is_savefile 成立
+const char* custom_tcpdump_savefile_path(const char* iface) {
+    return iface + sizeof(CUSTOM_TCPDUMP_SAVEFILE_PREFIX) - 1;
+}
+
+/*
+ * 打开网络接口并设置过滤规则（如果提供了 custom_filter）。
+ * iface 为 "file:<路径>" 时改用 pcap_open_offline，以最快速度读出其中的包，
+ * snaplen、promisc 和 timeout_ms 此时不起作用。
+ * 成功返回 0 并通过 handle 返回句柄；失败返回与 custom_tcpdump_capture 相同的错误码。
+ */
+int custom_tcpdump_open_live(const char* iface, const char* custom_filter, int snaplen, int promisc,
+                             int timeout_ms, pcap_t **handle) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    int offline = custom_tcpdump_is_savefile(iface);
+    int ret;
+
+    // 1. 打开网络接口进行抓包，或者打开抓包文件回放
+    if (offline) {
+        *handle = pcap_open_offline(custom_tcpdump_savefile_path(iface), errbuf);
+    } else {
+        *handle = pcap_open_live(iface, snaplen, promisc, timeout_ms, errbuf);
+    }
+    if (*handle == NULL) {
+        fprintf(stderr, "Error: cannot open %s %s - %s\n", offline ? "file" : "device", iface, errbuf);
+        return -1;
+    }
+
+    // 2. 编译并设置过滤规则（如果提供了 custom_filter），文件没有网络掩码可查
+    if ((ret = custom_tcpdump_set_filter(*handle, offline ? NULL : iface, custom_filter)) != 0) {
+        pcap_close(*handle);
+        return ret;
+    }
+    return 0;
+}
+
+int custom_tcpdump_capture(const char* iface, const char* custom_filter, void* buffer, size_t buffer_size) {
+    pcap_t *handle;
+    size_t offset = 0;
+    int snaplen = 65535;
+    int promisc = 1;
+    int timeout_ms = 1000;
+    int ret;
+
+    // 1-2. 打开网络接口并设置过滤规则
+    if ((ret = custom_tcpdump_open_live(iface, custom_filter, snaplen, promisc, timeout_ms, &handle)) != 0) {
+        return ret;
     }
 
     // 3. 抓包循环，将数据拷贝到用户缓冲区
@@ -59,3 +116,5 @@ int custom_tcpdump_capture(const char* iface, const char* custom_filter, void* b
     pcap_close(handle);
     return 0;
 }
+
+#endif // CUSTOM_TCPDUMP_H
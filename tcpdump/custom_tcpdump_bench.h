@@ -0,0 +1,131 @@
+#ifndef CUSTOM_TCPDUMP_BENCH_H
+#define CUSTOM_TCPDUMP_BENCH_H
+
+#include "custom_tcpdump.h"
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * 不依赖网卡的吞吐量测量：把抓包文件整个读进内存，
+ * 再反复执行 过滤规则编译 -> 逐包匹配 -> 拷贝到缓冲区，统计每秒包数和字节数。
+ * 文件读取不计入时间，测到的就是 custom_tcpdump_capture 在用户态的开销。
+ */
+
+struct custom_tcpdump_bench_result {
+    uint64_t packets;       // 每轮处理的包数
+    uint64_t matched;       // 每轮匹配过滤规则的包数
+    uint64_t bytes;         // 每轮拷贝的字节数
+    uint64_t compile_ns;    // 单次编译过滤规则的平均耗时
+    uint64_t elapsed_ns;    // 全部轮次匹配加拷贝的总耗时
+    double pps;             // 每秒处理的包数
+    double bps;             // 每秒拷贝的字节数
+};
+
+static uint64_t custom_tcpdump_bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * 对抓包文件 path 运行 iterations 轮测量。buffer 作为拷贝目标循环使用，
+ * 大小至少要放得下最大的一个包。
+ * 成功返回 0；文件打不开返回 -1，过滤规则错误返回 -2，内存不足或缓冲区太小返回 -5。
+ */
+int custom_tcpdump_bench_file(const char* path, const char* custom_filter, int iterations,
+                              void* buffer, size_t buffer_size, struct custom_tcpdump_bench_result *result) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *header, *headers = NULL;
+    const u_char *packet;
+    u_char *data = NULL, *p;
+    size_t data_size = 0, data_cap = 0, nr = 0, cap = 0, offset, i;
+    struct bpf_program bpf;
+    pcap_t *handle;
+    uint64_t start;
+    int ret = 0;
+    int it;
+
+    memset(result, 0, sizeof(*result));
+    if ((handle = pcap_open_offline(path, errbuf)) == NULL) {
+        fprintf(stderr, "Error: cannot open file %s - %s\n", path, errbuf);
+        return -1;
+    }
+
+    // 1. 把所有包读进内存，包头和数据分开连续存放
+    while (pcap_next_ex(handle, &header, &packet) == 1) {
+        if (nr == cap) {
+            cap = cap ? cap * 2 : 1024;
+            if ((p = realloc(headers, cap * sizeof(*headers))) == NULL) {
+                ret = -5;
+                goto out;
+            }
+            headers = (struct pcap_pkthdr *)p;
+        }
+        if (data_size + header->caplen > data_cap) {
+            data_cap = (data_cap ? data_cap * 2 : 1 << 20) + header->caplen;
+            if ((p = realloc(data, data_cap)) == NULL) {
+                ret = -5;
+                goto out;
+            }
+            data = p;
+        }
+        if (header->caplen > buffer_size) {
+            fprintf(stderr, "Error: buffer too small for a %u byte packet\n", header->caplen);
+            ret = -5;
+            goto out;
+        }
+        headers[nr++] = *header;
+        memcpy(data + data_size, packet, header->caplen);
+        data_size += header->caplen;
+    }
+
+    for (it = 0; it < iterations; it++) {
+        // 2. 编译过滤规则
+        start = custom_tcpdump_bench_now_ns();
+        if (pcap_compile(handle, &bpf, custom_filter != NULL ? custom_filter : "", 1, PCAP_NETMASK_UNKNOWN) == -1) {
+            fprintf(stderr, "Error: bad filter \"%s\" - %s\n", custom_filter, pcap_geterr(handle));
+            ret = -2;
+            goto out;
+        }
+        result->compile_ns += custom_tcpdump_bench_now_ns() - start;
+
+        // 3. 逐包匹配并拷贝，缓冲区写满后从头覆盖
+        result->matched = 0;
+        result->bytes = 0;
+        offset = 0;
+        p = data;
+        start = custom_tcpdump_bench_now_ns();
+        for (i = 0; i < nr; i++) {
+            if (pcap_offline_filter(&bpf, &headers[i], p) != 0) {
+                if (headers[i].caplen > buffer_size - offset) {
+                    offset = 0;
+                }
+                memcpy((u_char*)buffer + offset, p, headers[i].caplen);
+                offset += headers[i].caplen;
+                result->matched++;
+                result->bytes += headers[i].caplen;
+            }
+            p += headers[i].caplen;
+        }
+        result->elapsed_ns += custom_tcpdump_bench_now_ns() - start;
+        pcap_freecode(&bpf);
+    }
+
+    result->packets = nr;
+    if (iterations > 0) {
+        result->compile_ns /= (uint64_t)iterations;
+    }
+    if (result->elapsed_ns > 0) {
+        result->pps = (double)nr * iterations * 1e9 / (double)result->elapsed_ns;
+        result->bps = (double)result->bytes * iterations * 1e9 / (double)result->elapsed_ns;
+    }
+
+out:
+    free(headers);
+    free(data);
+    pcap_close(handle);
+    return ret;
+}
+
+#endif // CUSTOM_TCPDUMP_BENCH_H
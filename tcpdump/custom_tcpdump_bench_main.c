@@ -0,0 +1,163 @@
+/*
+ * 不依赖网卡的回归基准：对 traces/ 下提交的样例抓包文件，
+ * 逐个过滤规则运行 custom_tcpdump_bench_file，输出每秒包数和字节数。
+ *
+ * 每个组合还会通过 "file:<路径>" 走一遍 custom_tcpdump_run 的回放路径，
+ * 核对按同一条规则过滤后交付的包数与基准里匹配的包数一致。
+ *
+ * -o FILE 把结果记为基准，-c FILE 与之前记录的基准比较，
+ * 任何组合的包速率低于基准的 (1 - 容差) 倍即返回 1，容差由 -t 指定，默认 0.2。
+ *
+ * 编译：gcc -O2 -pthread -o custom_tcpdump_bench_main custom_tcpdump_bench_main.c -lpcap
+ * 运行：./custom_tcpdump_bench_main [-n 轮数] [-o 基准文件 | -c 基准文件 [-t 容差]] [traces 目录]
+ */
+
+#include "custom_tcpdump_bench.h"
+#include "custom_tcpdump_engine.h"
+#include <unistd.h>
+
+static const char *const bench_traces[] = {
+    "udp_small.pcap",
+    "imix.pcap",
+    "v6_vlan_mixed.pcap",
+};
+
+static const char *const bench_filters[] = {
+    "",
+    "udp",
+    "tcp port 80 or tcp port 443",
+    "udp dst port 53 and src net 10.0.0.0/16",
+    "ip6 and tcp",
+    "vlan and ip",
+    "icmp or arp",
+};
+
+#define BENCH_NR_TRACES  (sizeof(bench_traces) / sizeof(bench_traces[0]))
+#define BENCH_NR_FILTERS (sizeof(bench_filters) / sizeof(bench_filters[0]))
+
+struct bench_baseline {
+    char trace[64];
+    int filter;
+    double pps;
+};
+
+static void bench_count_cb(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    (void)user;
+    (void)header;
+    (void)packet;
+}
+
+// 读取 -o 写出的基准文件，每行 "<trace> <filter 下标> <pps>"
+static int bench_load_baseline(const char *path, struct bench_baseline *base, int max) {
+    FILE *fp = fopen(path, "r");
+    int n = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: cannot open baseline %s - %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (n < max && fscanf(fp, "%63s %d %lf", base[n].trace, &base[n].filter, &base[n].pps) == 3) {
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static const struct bench_baseline *bench_find_baseline(const struct bench_baseline *base, int n,
+                                                        const char *trace, int filter) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (base[i].filter == filter && strcmp(base[i].trace, trace) == 0) {
+            return &base[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    struct custom_tcpdump_options opts = CUSTOM_TCPDUMP_OPTIONS_DEFAULT;
+    struct bench_baseline base[BENCH_NR_TRACES * BENCH_NR_FILTERS];
+    const struct bench_baseline *b;
+    struct custom_tcpdump_bench_result res;
+    struct custom_tcpdump_stats stats;
+    const char *dir = "traces";
+    const char *save_path = NULL, *compare_path = NULL;
+    double tolerance = 0.2;
+    char path[4096], source[4096 + 8];
+    size_t buffer_size = 1 << 20;
+    void *buffer;
+    FILE *save = NULL;
+    int iterations = 200;
+    int nr_base = 0, failed = 0;
+    size_t t, f;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:o:c:t:")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'o': save_path = optarg; break;
+        case 'c': compare_path = optarg; break;
+        case 't': tolerance = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-o baseline | -c baseline [-t tolerance]] [traces_dir]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc) {
+        dir = argv[optind];
+    }
+    if (compare_path != NULL &&
+        (nr_base = bench_load_baseline(compare_path, base, (int)(sizeof(base) / sizeof(base[0])))) < 0) {
+        return 2;
+    }
+    if (save_path != NULL && (save = fopen(save_path, "w")) == NULL) {
+        fprintf(stderr, "Error: cannot create baseline %s - %s\n", save_path, strerror(errno));
+        return 2;
+    }
+    if ((buffer = malloc(buffer_size)) == NULL) {
+        return 2;
+    }
+
+    printf("%-20s %-42s %8s %8s %10s %12s %10s\n", "trace", "filter", "packets", "matched",
+           "compile us", "pkts/s", "MB/s");
+    for (t = 0; t < BENCH_NR_TRACES; t++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, bench_traces[t]);
+        snprintf(source, sizeof(source), "%s%s", CUSTOM_TCPDUMP_SAVEFILE_PREFIX, path);
+        for (f = 0; f < BENCH_NR_FILTERS; f++) {
+            if (custom_tcpdump_bench_file(path, bench_filters[f], iterations, buffer, buffer_size, &res) != 0) {
+                failed = 1;
+                continue;
+            }
+            printf("%-20s %-42s %8llu %8llu %10.1f %12.0f %10.1f",
+                   bench_traces[t], bench_filters[f][0] ? bench_filters[f] : "(none)",
+                   (unsigned long long)res.packets, (unsigned long long)res.matched,
+                   res.compile_ns / 1e3, res.pps, res.bps / 1e6);
+
+            // 回放路径交付的包数必须与基准里的匹配数一致
+            memset(&stats, 0, sizeof(stats));
+            if (custom_tcpdump_run(source, bench_filters[f], &opts, NULL, bench_count_cb, NULL, &stats) != 0 ||
+                stats.stop_reason != CUSTOM_TCPDUMP_STOP_EOF || stats.packets != res.matched) {
+                printf("  REPLAY MISMATCH (%llu)", (unsigned long long)stats.packets);
+                failed = 1;
+            }
+            if (save != NULL) {
+                fprintf(save, "%s %zu %.0f\n", bench_traces[t], f, res.pps);
+            }
+            if (nr_base > 0 && (b = bench_find_baseline(base, nr_base, bench_traces[t], (int)f)) != NULL) {
+                printf("  %+.1f%%", (res.pps / b->pps - 1) * 100);
+                if (res.pps < b->pps * (1 - tolerance)) {
+                    printf(" REGRESSION");
+                    failed = 1;
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    if (save != NULL) {
+        fclose(save);
+    }
+    free(buffer);
+    return failed;
+}
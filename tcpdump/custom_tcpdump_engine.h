@@ -0,0 +1,385 @@
+#ifndef CUSTOM_TCPDUMP_ENGINE_H
+#define CUSTOM_TCPDUMP_ENGINE_H
+
+#include "custom_tcpdump.h"
+#include "custom_tcpdump_records.h"
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * 基于 pcap_dispatch 的批量抓包引擎。
+ * 每次库调用处理内核缓冲区里已有的一批包，通过回调交给调用者，
+ * 支持包数、字节数和截止时间三种停止条件，并可以从其他线程取消。
+ */
+
+struct custom_tcpdump_options {
+    int snaplen;
+    int promisc;
+    int timeout_ms;       // 阻塞模式下单次 pcap_dispatch 最长等待时间，也是检查停止条件的间隔
+    int immediate;        // 立即模式：包一到就交付，不等缓冲区攒满
+    int buffer_size;      // 内核缓冲区字节数，0 表示使用 libpcap 默认值
+    int nonblock;         // 非阻塞模式：无包时用 poll 等待，而不是阻塞在 pcap_dispatch 里
+    int batch;            // 单次 pcap_dispatch 最多处理的包数，-1 表示处理缓冲区中的全部
+    uint64_t max_packets; // 0 表示不限
+    uint64_t max_bytes;   // 按 caplen 累计，0 表示不限
+    uint64_t duration_ms; // 从开始抓包算起的时间上限，0 表示不限
+    double replay_speed;  // 回放抓包文件时的速度倍数，1.0 为原始节奏，0 表示不等待、全速回放
+};
+
+#define CUSTOM_TCPDUMP_OPTIONS_DEFAULT { \
+    .snaplen = 65535,                    \
+    .promisc = 1,                        \
+    .timeout_ms = 100,                   \
+    .immediate = 0,                      \
+    .buffer_size = 0,                    \
+    .nonblock = 0,                       \
+    .batch = -1,                         \
+    .replay_speed = 0,                   \
+}
+
+#define CUSTOM_TCPDUMP_STOP_CANCELLED 1
+#define CUSTOM_TCPDUMP_STOP_PACKETS   2
+#define CUSTOM_TCPDUMP_STOP_BYTES     3
+#define CUSTOM_TCPDUMP_STOP_DEADLINE  4
+#define CUSTOM_TCPDUMP_STOP_EOF       5   // 离线文件读完
+#define CUSTOM_TCPDUMP_STOP_BUFFER_FULL 6 // 调用者的缓冲区写满
+#define CUSTOM_TCPDUMP_STOP_WRITE_ERROR 7 // 写盘出错，见 custom_tcpdump_rotate
+
+struct custom_tcpdump_stats {
+    uint64_t packets;
+    uint64_t bytes;
+    unsigned int ps_recv;   // pcap_stats 报告的接收数
+    unsigned int ps_drop;   // 内核缓冲区溢出丢弃数
+    int stop_reason;
+};
+
+/*
+ * 取消句柄。在启动抓包前用 custom_tcpdump_session_init 初始化，
+ * 其他线程（或回调内部）调用 custom_tcpdump_cancel 即可让 custom_tcpdump_run 尽快返回。
+ */
+struct custom_tcpdump_session {
+    pthread_mutex_t lock;
+    pcap_t *handle;
+    volatile int cancelled;
+};
+
+void custom_tcpdump_session_init(struct custom_tcpdump_session *session) {
+    pthread_mutex_init(&session->lock, NULL);
+    session->handle = NULL;
+    session->cancelled = 0;
+}
+
+void custom_tcpdump_session_destroy(struct custom_tcpdump_session *session) {
+    pthread_mutex_destroy(&session->lock);
+}
+
+void custom_tcpdump_cancel(struct custom_tcpdump_session *session) {
+    pthread_mutex_lock(&session->lock);
+    session->cancelled = 1;
+    if (session->handle != NULL) {
+        pcap_breakloop(session->handle);
+    }
+    pthread_mutex_unlock(&session->lock);
+}
+
+/*
+ * 按选项创建并激活句柄，再设置过滤规则。
+ * iface 为 "file:<路径>" 时转给 custom_tcpdump_open_live 按文件打开，只有过滤规则生效。
+ * 错误码与 custom_tcpdump_capture 一致。
+ */
+int custom_tcpdump_open_ex(const char* iface, const char* custom_filter, const struct custom_tcpdump_options *opts,
+                           pcap_t **handle) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    int ret;
+
+    if (custom_tcpdump_is_savefile(iface)) {
+        return custom_tcpdump_open_live(iface, custom_filter, opts->snaplen, opts->promisc, opts->timeout_ms, handle);
+    }
+    if ((*handle = pcap_create(iface, errbuf)) == NULL) {
+        fprintf(stderr, "Error: cannot open device %s - %s\n", iface, errbuf);
+        return -1;
+    }
+    pcap_set_snaplen(*handle, opts->snaplen);
+    pcap_set_promisc(*handle, opts->promisc);
+    pcap_set_timeout(*handle, opts->timeout_ms);
+    if (opts->immediate) {
+        pcap_set_immediate_mode(*handle, 1);
+    }
+    if (opts->buffer_size > 0) {
+        pcap_set_buffer_size(*handle, opts->buffer_size);
+    }
+    if ((ret = pcap_activate(*handle)) < 0) {
+        fprintf(stderr, "Error: cannot activate device %s - %s\n", iface,
+                ret == PCAP_ERROR ? pcap_geterr(*handle) : pcap_statustostr(ret));
+        pcap_close(*handle);
+        return -1;
+    }
+    if (ret > 0) {
+        fprintf(stderr, "Warning: device %s activated with warning - %s\n", iface, pcap_statustostr(ret));
+    }
+    if (opts->nonblock && pcap_setnonblock(*handle, 1, errbuf) == -1) {
+        fprintf(stderr, "Error: cannot set nonblocking mode on %s - %s\n", iface, errbuf);
+        pcap_close(*handle);
+        return -1;
+    }
+
+    if ((ret = custom_tcpdump_set_filter(*handle, iface, custom_filter)) != 0) {
+        pcap_close(*handle);
+        return ret;
+    }
+    return 0;
+}
+
+static uint64_t custom_tcpdump_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*
+ * 按原始节奏回放：以第一个包为基准，睡到 (包时间戳 - 第一个包时间戳) / speed 之后再交付。
+ * 处理慢于原始节奏时不等待，也不补偿，后面的包照常按基准对齐。
+ */
+struct custom_tcpdump_pace {
+    double speed;
+    int started;
+    struct timeval first_ts;
+    struct timespec start;
+};
+
+void custom_tcpdump_pace_wait(struct custom_tcpdump_pace *pace, const struct pcap_pkthdr *header) {
+    struct timeval delta;
+    struct timespec target;
+    uint64_t offset_ns;
+
+    if (!pace->started) {
+        pace->started = 1;
+        pace->first_ts = header->ts;
+        clock_gettime(CLOCK_MONOTONIC, &pace->start);
+        return;
+    }
+    timersub(&header->ts, &pace->first_ts, &delta);
+    if (delta.tv_sec < 0) {
+        return;
+    }
+    offset_ns = (uint64_t)(((double)delta.tv_sec * 1e9 + (double)delta.tv_usec * 1e3) / pace->speed);
+    target.tv_sec = pace->start.tv_sec + (time_t)(offset_ns / 1000000000u);
+    target.tv_nsec = pace->start.tv_nsec + (long)(offset_ns % 1000000000u);
+    if (target.tv_nsec >= 1000000000L) {
+        target.tv_sec++;
+        target.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) == EINTR) {
+    }
+}
+
+struct custom_tcpdump_dispatch_ctx {
+    const struct custom_tcpdump_options *opts;
+    struct custom_tcpdump_stats *stats;
+    pcap_t *handle;
+    pcap_handler callback;
+    u_char *user;
+    struct custom_tcpdump_pace *pace;  // 非 NULL 时按原始节奏回放
+    uint64_t deadline;
+};
+
+// 包装用户回调，累计计数并在达到包数或字节数上限时结束本轮 dispatch
+static void custom_tcpdump_dispatch_cb(u_char *arg, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct custom_tcpdump_dispatch_ctx *ctx = (struct custom_tcpdump_dispatch_ctx *)arg;
+
+    // 回调自己结束了抓包（例如缓冲区写满），本轮剩下的包不再交付，也不计数
+    if (ctx->stats->stop_reason != 0) {
+        return;
+    }
+
+    // 回放文件时一次 dispatch 会读完整个文件，截止时间只能在这里检查
+    if (ctx->pace != NULL) {
+        custom_tcpdump_pace_wait(ctx->pace, header);
+        if (ctx->deadline && custom_tcpdump_now_ms() >= ctx->deadline) {
+            ctx->stats->stop_reason = CUSTOM_TCPDUMP_STOP_DEADLINE;
+            pcap_breakloop(ctx->handle);
+            return;
+        }
+    }
+
+    ctx->callback(ctx->user, header, packet);
+    if (ctx->stats->stop_reason != 0) {
+        return;
+    }
+    ctx->stats->packets++;
+    ctx->stats->bytes += header->caplen;
+
+    if (ctx->opts->max_packets && ctx->stats->packets >= ctx->opts->max_packets) {
+        ctx->stats->stop_reason = CUSTOM_TCPDUMP_STOP_PACKETS;
+        pcap_breakloop(ctx->handle);
+    } else if (ctx->opts->max_bytes && ctx->stats->bytes >= ctx->opts->max_bytes) {
+        ctx->stats->stop_reason = CUSTOM_TCPDUMP_STOP_BYTES;
+        pcap_breakloop(ctx->handle);
+    }
+}
+
+/*
+ * 在已经打开的句柄上运行抓包循环，直到满足某个停止条件。
+ * 回放抓包文件时读完文件即停止（CUSTOM_TCPDUMP_STOP_EOF），opts->replay_speed 控制回放节奏。
+ * session 可以为 NULL；stats 返回计数和停止原因。
+ * 正常停止返回 0，pcap_dispatch 出错返回 -4。
+ */
+int custom_tcpdump_run_handle(pcap_t *handle, const struct custom_tcpdump_options *opts,
+                              struct custom_tcpdump_session *session, pcap_handler callback, u_char *user,
+                              struct custom_tcpdump_stats *stats) {
+    struct custom_tcpdump_dispatch_ctx ctx = { opts, stats, handle, callback, user, NULL, 0 };
+    uint64_t deadline = opts->duration_ms ? custom_tcpdump_now_ms() + opts->duration_ms : 0;
+    int offline = pcap_file(handle) != NULL;
+    struct custom_tcpdump_pace pace = { .speed = opts->replay_speed };
+    struct pcap_stat ps;
+    struct pollfd pfd;
+    uint64_t now;
+    int wait_ms;
+    int ret = 0;
+    int n;
+
+    memset(stats, 0, sizeof(*stats));
+    if (offline && opts->replay_speed > 0) {
+        ctx.pace = &pace;
+        ctx.deadline = deadline;
+    }
+    if (session != NULL) {
+        pthread_mutex_lock(&session->lock);
+        session->handle = handle;
+        pthread_mutex_unlock(&session->lock);
+    }
+
+    while (stats->stop_reason == 0) {
+        if (session != NULL && session->cancelled) {
+            stats->stop_reason = CUSTOM_TCPDUMP_STOP_CANCELLED;
+            break;
+        }
+        now = deadline ? custom_tcpdump_now_ms() : 0;
+        if (deadline && now >= deadline) {
+            stats->stop_reason = CUSTOM_TCPDUMP_STOP_DEADLINE;
+            break;
+        }
+
+        n = pcap_dispatch(handle, opts->batch, custom_tcpdump_dispatch_cb, (u_char *)&ctx);
+        if (n == PCAP_ERROR_BREAK) {
+            // 由停止条件、回调里的 custom_tcpdump_stop 或 custom_tcpdump_cancel 触发
+            if (stats->stop_reason == 0 && session != NULL && session->cancelled) {
+                stats->stop_reason = CUSTOM_TCPDUMP_STOP_CANCELLED;
+            }
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "Error: pcap_dispatch failed - %s\n", pcap_geterr(handle));
+            ret = -4;
+            break;
+        }
+        if (n == 0 && offline) {
+            stats->stop_reason = CUSTOM_TCPDUMP_STOP_EOF;
+            break;
+        }
+
+        // 非阻塞模式下没有包时等待句柄可读，最多等到截止时间
+        if (n == 0 && opts->nonblock) {
+            wait_ms = opts->timeout_ms;
+            if (deadline && deadline - now < (uint64_t)wait_ms) {
+                wait_ms = (int)(deadline - now);
+            }
+            pfd.fd = pcap_get_selectable_fd(handle);
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (pfd.fd >= 0 && poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+                fprintf(stderr, "Error: poll failed - %s\n", strerror(errno));
+                ret = -4;
+                break;
+            }
+        }
+    }
+
+    if (pcap_stats(handle, &ps) == 0) {
+        stats->ps_recv = ps.ps_recv;
+        stats->ps_drop = ps.ps_drop;
+    }
+    if (session != NULL) {
+        pthread_mutex_lock(&session->lock);
+        session->handle = NULL;
+        pthread_mutex_unlock(&session->lock);
+    }
+    return ret;
+}
+
+// 打开接口并运行抓包循环，结束后关闭句柄
+int custom_tcpdump_run(const char* iface, const char* custom_filter, const struct custom_tcpdump_options *opts,
+                       struct custom_tcpdump_session *session, pcap_handler callback, u_char *user,
+                       struct custom_tcpdump_stats *stats) {
+    pcap_t *handle;
+    int ret;
+
+    if ((ret = custom_tcpdump_open_ex(iface, custom_filter, opts, &handle)) != 0) {
+        return ret;
+    }
+    ret = custom_tcpdump_run_handle(handle, opts, session, callback, user, stats);
+    pcap_close(handle);
+    return ret;
+}
+
+/*
+ * 在回调里结束 custom_tcpdump_run_handle：记下停止原因并让当前 pcap_dispatch 返回。
+ * 与 custom_tcpdump_cancel 不同，不会改动调用者的 session，同一个 session 可以继续用于下一次抓包。
+ * 设置原因的这个包不计入 stats。
+ */
+void custom_tcpdump_stop(pcap_t *handle, struct custom_tcpdump_stats *stats, int reason) {
+    if (stats->stop_reason == 0) {
+        stats->stop_reason = reason;
+    }
+    pcap_breakloop(handle);
+}
+
+struct custom_tcpdump_batched_ctx {
+    struct custom_tcpdump_records rec;
+    pcap_t *handle;
+    struct custom_tcpdump_stats *stats;
+};
+
+static void custom_tcpdump_batched_cb(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct custom_tcpdump_batched_ctx *ctx = (struct custom_tcpdump_batched_ctx *)user;
+
+    if (custom_tcpdump_records_append(&ctx->rec, header, packet) != 0) {
+        custom_tcpdump_stop(ctx->handle, ctx->stats, CUSTOM_TCPDUMP_STOP_BUFFER_FULL);
+    }
+}
+
+/*
+ * 批量引擎版本的 custom_tcpdump_capture_records：按 opts 的停止条件抓包，
+ * 以带记录头和索引的格式写入 buffer。session 可以为 NULL。
+ * buffer 写满时停止，stats->stop_reason 为 CUSTOM_TCPDUMP_STOP_BUFFER_FULL。
+ */
+int custom_tcpdump_capture_batched(const char* iface, const char* custom_filter, const struct custom_tcpdump_options *opts,
+                                   struct custom_tcpdump_session *session, int format, void* buffer, size_t buffer_size,
+                                   struct custom_tcpdump_result *result, struct custom_tcpdump_stats *stats) {
+    struct custom_tcpdump_batched_ctx ctx;
+    pcap_t *handle;
+    int ret;
+
+    if ((ret = custom_tcpdump_open_ex(iface, custom_filter, opts, &handle)) != 0) {
+        return ret;
+    }
+    if ((ret = custom_tcpdump_records_init(&ctx.rec, buffer, buffer_size, format, pcap_datalink(handle), opts->snaplen)) != 0) {
+        pcap_close(handle);
+        return ret;
+    }
+    ctx.handle = handle;
+    ctx.stats = stats;
+    ret = custom_tcpdump_run_handle(handle, opts, session, custom_tcpdump_batched_cb, (u_char *)&ctx, stats);
+    if (stats->stop_reason == CUSTOM_TCPDUMP_STOP_BUFFER_FULL) {
+        fprintf(stderr, "Buffer is full, stopping capture.\n");
+    }
+    custom_tcpdump_records_finish(&ctx.rec, result);
+    pcap_close(handle);
+    return ret;
+}
+
+#endif // CUSTOM_TCPDUMP_ENGINE_H
@@ -0,0 +1,323 @@
+#ifndef CUSTOM_TCPDUMP_FANOUT_H
+#define CUSTOM_TCPDUMP_FANOUT_H
+
+// pthread_setaffinity_np 和 CPU_SET 需要 _GNU_SOURCE：本文件要在所有系统头文件之前包含，
+// 或者在编译选项里加 -D_GNU_SOURCE
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "custom_tcpdump_ring.h"
+#include "custom_tcpdump_records.h"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+ * 多线程抓包：在同一个 PACKET_FANOUT 组里打开 N 个 TPACKET_V3 套接字，
+ * 内核按流哈希或按收包 CPU 把包分给各个套接字。
+ * 每个套接字由一个工作线程处理，写入线程自己的输出缓冲区，互不加锁；
+ * 需要时再按时间戳把各个缓冲区归并成一个。
+ */
+
+#define CUSTOM_TCPDUMP_FANOUT_HASH PACKET_FANOUT_HASH
+#define CUSTOM_TCPDUMP_FANOUT_CPU  PACKET_FANOUT_CPU
+
+struct custom_tcpdump_fanout;
+
+struct custom_tcpdump_fanout_worker {
+    struct custom_tcpdump_fanout *owner;
+    pthread_t thread;
+    int started;
+    int cpu;                        // CPU 模式下绑定的 CPU，-1 表示不绑定
+    struct custom_tcpdump_ring ring;
+    void *buffer;
+    struct custom_tcpdump_records rec;
+    struct custom_tcpdump_result result;
+    // 来自 PACKET_STATISTICS，内核每次读取后清零，这里累计
+    uint64_t kernel_packets;
+    uint64_t kernel_drops;
+    uint64_t freeze_count;
+    int error;
+};
+
+struct custom_tcpdump_fanout {
+    int nr_workers;
+    int mode;
+    int group;                      // 内核分配的 fanout 组 ID
+    int format;
+    int snaplen;
+    int linktype;                   // 接口的 DLT_*，所有工作线程相同
+    uint64_t deadline_ms;           // CLOCK_MONOTONIC 毫秒，0 表示不限
+    int stop;                       // 任意线程都可能置位，用 __atomic 读写
+    struct custom_tcpdump_fanout_worker *workers;
+};
+
+struct custom_tcpdump_fanout_stats {
+    uint64_t packets;               // 写入该线程缓冲区的包数
+    uint64_t kernel_packets;        // 内核交给该套接字的包数
+    uint64_t kernel_drops;          // 环满时内核丢弃的包数
+    uint64_t freeze_count;          // 环被冻结的次数
+    int buffer_full;
+};
+
+static uint64_t custom_tcpdump_fanout_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void custom_tcpdump_fanout_read_stats(struct custom_tcpdump_fanout_worker *w) {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if (w->ring.fd >= 0 && getsockopt(w->ring.fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+        w->kernel_packets += st.tp_packets;
+        w->kernel_drops += st.tp_drops;
+        w->freeze_count += st.tp_freeze_q_cnt;
+    }
+}
+
+static void *custom_tcpdump_fanout_thread(void *arg) {
+    struct custom_tcpdump_fanout_worker *w = (struct custom_tcpdump_fanout_worker *)arg;
+    struct custom_tcpdump_fanout *f = w->owner;
+    cpu_set_t set;
+    int ret;
+
+    if (w->cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    while (!__atomic_load_n(&f->stop, __ATOMIC_ACQUIRE) && !w->rec.full) {
+        if (f->deadline_ms && custom_tcpdump_fanout_now_ms() >= f->deadline_ms) {
+            break;
+        }
+        ret = custom_tcpdump_ring_dispatch(&w->ring, 100, custom_tcpdump_records_handler, (u_char *)&w->rec);
+        if (ret < 0) {
+            w->error = ret;
+            break;
+        }
+    }
+
+    custom_tcpdump_fanout_read_stats(w);
+    custom_tcpdump_records_finish(&w->rec, &w->result);
+    return NULL;
+}
+
+/*
+ * 打开 nr_workers 个同组套接字并启动工作线程。
+ * 每个线程分配 buffer_size 字节的输出缓冲区，格式同 custom_tcpdump_capture_records。
+ * duration_ms 为 0 时一直抓到 custom_tcpdump_fanout_stop。
+ * 所有套接字在启动线程前加入组，保证内核从一开始就在全部成员间分流。
+ */
+int custom_tcpdump_fanout_start(struct custom_tcpdump_fanout *f, const char* iface, const char* custom_filter,
+                                int nr_workers, int mode, const struct custom_tcpdump_ring_config *config,
+                                int format, size_t buffer_size, uint64_t duration_ms) {
+    static const struct custom_tcpdump_ring_config default_config = CUSTOM_TCPDUMP_RING_CONFIG_DEFAULT;
+    struct custom_tcpdump_fanout_worker *w;
+    socklen_t len;
+    int fanout_flags;
+    int fanout_arg;
+    int ret = 0;
+    int i;
+
+    if (config == NULL) {
+        config = &default_config;
+    }
+    memset(f, 0, sizeof(*f));
+    f->nr_workers = nr_workers;
+    f->mode = mode;
+    f->format = format;
+    f->snaplen = config->snaplen;
+    if ((f->workers = calloc(nr_workers, sizeof(*f->workers))) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+
+    // 出错时统一清理全部工作线程，先把每个套接字都标记为未打开
+    for (i = 0; i < nr_workers; i++) {
+        w = &f->workers[i];
+        w->owner = f;
+        w->ring.fd = -1;
+        w->cpu = (mode == CUSTOM_TCPDUMP_FANOUT_CPU) ? i : -1;
+    }
+
+    fanout_flags = mode;
+    if (mode == CUSTOM_TCPDUMP_FANOUT_HASH) {
+        // 分片重组后再计算哈希，保证同一个流的分片落到同一个线程
+        fanout_flags |= PACKET_FANOUT_FLAG_DEFRAG;
+    }
+
+    // 1. 打开全部套接字并加入同一个 fanout 组
+    for (i = 0; i < nr_workers; i++) {
+        w = &f->workers[i];
+        if ((w->buffer = malloc(buffer_size)) == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            ret = -1;
+            goto fail;
+        }
+        if ((ret = custom_tcpdump_ring_open(&w->ring, iface, custom_filter, config)) != 0) {
+            goto fail;
+        }
+        f->linktype = w->ring.linktype;
+        if ((ret = custom_tcpdump_records_init(&w->rec, w->buffer, buffer_size, format, f->linktype,
+                                               config->snaplen)) != 0) {
+            goto fail;
+        }
+        /*
+         * 第一个套接字让内核分配一个未被使用的组 ID，避免与其他进程（包括 PID 低 16 位
+         * 相同的进程）的组冲突；其余套接字用读回的 ID 加入同一个组。
+         */
+        if (i == 0) {
+            fanout_arg = (fanout_flags | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+        } else {
+            fanout_arg = f->group | (fanout_flags << 16);
+        }
+        if (setsockopt(w->ring.fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) == -1) {
+            fprintf(stderr, "Error: cannot join fanout group %d - %s\n", f->group, strerror(errno));
+            ret = -4;
+            goto fail;
+        }
+        if (i == 0) {
+            len = sizeof(fanout_arg);
+            if (getsockopt(w->ring.fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, &len) == -1) {
+                fprintf(stderr, "Error: cannot read fanout group id - %s\n", strerror(errno));
+                ret = -4;
+                goto fail;
+            }
+            f->group = fanout_arg & 0xffff;
+        }
+    }
+
+    // 2. 启动工作线程
+    f->deadline_ms = duration_ms ? custom_tcpdump_fanout_now_ms() + duration_ms : 0;
+    for (i = 0; i < nr_workers; i++) {
+        w = &f->workers[i];
+        if (pthread_create(&w->thread, NULL, custom_tcpdump_fanout_thread, w) != 0) {
+            fprintf(stderr, "Error: cannot create capture thread %d\n", i);
+            ret = -1;
+            goto fail;
+        }
+        w->started = 1;
+    }
+    return 0;
+
+fail:
+    __atomic_store_n(&f->stop, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < nr_workers; i++) {
+        w = &f->workers[i];
+        if (w->started) {
+            pthread_join(w->thread, NULL);
+        }
+        custom_tcpdump_ring_close(&w->ring);
+        free(w->buffer);
+    }
+    free(f->workers);
+    f->workers = NULL;
+    return ret;
+}
+
+/*
+ * 等待所有工作线程结束（到达截止时间、缓冲区写满或已调用 stop）。
+ * 只能由调用 start 的线程调用，同一个线程不能被 join 两次。
+ */
+void custom_tcpdump_fanout_wait(struct custom_tcpdump_fanout *f) {
+    int i;
+
+    for (i = 0; i < f->nr_workers; i++) {
+        if (f->workers[i].started) {
+            pthread_join(f->workers[i].thread, NULL);
+            f->workers[i].started = 0;
+        }
+    }
+}
+
+/*
+ * 通知所有工作线程停止，不等待。只写一个标志，可以从任意线程或信号处理函数里调用，
+ * 也可以重复调用；之后由拥有者调用 wait 或 destroy 回收线程。
+ */
+void custom_tcpdump_fanout_stop(struct custom_tcpdump_fanout *f) {
+    __atomic_store_n(&f->stop, 1, __ATOMIC_RELEASE);
+}
+
+// 线程结束后可以读取，返回该线程的缓冲区内容和统计
+void custom_tcpdump_fanout_worker_stats(const struct custom_tcpdump_fanout *f, int i,
+                                        struct custom_tcpdump_fanout_stats *stats) {
+    const struct custom_tcpdump_fanout_worker *w = &f->workers[i];
+
+    stats->packets = w->result.record_count;
+    stats->kernel_packets = w->kernel_packets;
+    stats->kernel_drops = w->kernel_drops;
+    stats->freeze_count = w->freeze_count;
+    stats->buffer_full = w->rec.full;
+}
+
+const void *custom_tcpdump_fanout_worker_buffer(const struct custom_tcpdump_fanout *f, int i,
+                                                struct custom_tcpdump_result *result) {
+    *result = f->workers[i].result;
+    return f->workers[i].buffer;
+}
+
+/*
+ * 按时间戳把各线程的缓冲区归并到 buffer 中，输出格式与单线程相同。
+ * 借助每个缓冲区的索引逐条取包，不需要重新解析。buffer 放不下时截断。
+ */
+int custom_tcpdump_fanout_merge(const struct custom_tcpdump_fanout *f, void* buffer, size_t buffer_size,
+                                struct custom_tcpdump_result *result) {
+    struct custom_tcpdump_records out;
+    struct pcap_pkthdr header, best_header;
+    const u_char *packet, *best_packet = NULL;
+    uint32_t *pos;
+    int best, i, ret;
+
+    if ((ret = custom_tcpdump_records_init(&out, buffer, buffer_size, f->format, f->linktype, f->snaplen)) != 0) {
+        return ret;
+    }
+    if ((pos = calloc(f->nr_workers, sizeof(*pos))) == NULL) {
+        return -1;
+    }
+
+    for (;;) {
+        best = -1;
+        for (i = 0; i < f->nr_workers; i++) {
+            const struct custom_tcpdump_fanout_worker *w = &f->workers[i];
+
+            if (custom_tcpdump_records_get(w->buffer, w->result.bytes_used, pos[i], &header, &packet) != 0) {
+                continue;
+            }
+            if (best < 0 || timercmp(&header.ts, &best_header.ts, <)) {
+                best = i;
+                best_header = header;
+                best_packet = packet;
+            }
+        }
+        if (best < 0 || custom_tcpdump_records_append(&out, &best_header, best_packet) != 0) {
+            break;
+        }
+        pos[best]++;
+    }
+
+    free(pos);
+    custom_tcpdump_records_finish(&out, result);
+    return 0;
+}
+
+void custom_tcpdump_fanout_destroy(struct custom_tcpdump_fanout *f) {
+    int i;
+
+    if (f->workers == NULL) {
+        return;
+    }
+    custom_tcpdump_fanout_stop(f);
+    custom_tcpdump_fanout_wait(f);
+    for (i = 0; i < f->nr_workers; i++) {
+        custom_tcpdump_ring_close(&f->workers[i].ring);
+        free(f->workers[i].buffer);
+    }
+    free(f->workers);
+    f->workers = NULL;
+}
+
+#endif // CUSTOM_TCPDUMP_FANOUT_H
@@ -0,0 +1,332 @@
+#ifndef CUSTOM_TCPDUMP_FLOW_H
+#define CUSTOM_TCPDUMP_FLOW_H
+
+#include "custom_tcpdump_engine.h"
+#include <stdint.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/*
+ * 抓包时按流聚合，只保留每个流的统计，不保存包内容。
+ *
+ * 回调里直接解析 Ethernet（含 VLAN）、IPv4/IPv6 和 TCP/UDP 头，
+ * 以 (源地址, 目的地址, 源端口, 目的端口, 协议) 为键更新开放寻址哈希表。
+ * 哈希表就建在调用者的 buffer 里，占用的内存只和流的数量有关，与抓到的字节数无关，
+ * 抓包时 snaplen 设成 128 左右就足够解析到传输层。
+ *
+ * 结束后调用 custom_tcpdump_flow_finish 把有效表项紧凑到 buffer 开头，
+ * 得到 struct custom_tcpdump_flow 数组。
+ */
+
+struct custom_tcpdump_flow_key {
+    uint8_t src[16];        // IPv4 地址只用前 4 字节
+    uint8_t dst[16];
+    uint16_t sport;         // 主机字节序，非 TCP/UDP 或非首个分片时为 0
+    uint16_t dport;
+    uint8_t family;         // AF_INET 或 AF_INET6
+    uint8_t proto;          // IPPROTO_*
+    uint8_t pad[2];
+};
+
+struct custom_tcpdump_flow {
+    struct custom_tcpdump_flow_key key;
+    uint64_t packets;
+    uint64_t bytes;         // 按线上长度累计
+    struct timeval first;
+    struct timeval last;
+    uint32_t syn;           // 各 TCP 标志出现的包数
+    uint32_t fin;
+    uint32_t rst;
+    uint32_t psh;
+    uint32_t ack;
+    uint32_t urg;
+    uint32_t used;          // 0 表示空槽
+    uint32_t hash;
+};
+
+struct custom_tcpdump_flow_table {
+    struct custom_tcpdump_flow *slots;
+    uint32_t capacity;      // 2 的幂
+    uint32_t count;
+    uint32_t limit;         // 装载因子上限，超过后新流计入 overflow
+    int linktype;
+    uint64_t packets;       // 交给聚合的总包数
+    uint64_t not_ip;        // 不是 IP 或头部被截断的包数
+    uint64_t overflow;      // 表满后没能记录的新流的包数
+};
+
+struct custom_tcpdump_flow_result {
+    uint32_t flow_count;
+    size_t bytes_used;      // flow_count * sizeof(struct custom_tcpdump_flow)
+    uint64_t packets;
+    uint64_t not_ip;
+    uint64_t overflow;
+};
+
+/*
+ * 在 buffer 上建立空表。容量取 buffer 能放下的最大 2 的幂，最多填到 3/4。
+ * 支持 DLT_EN10MB、DLT_LINUX_SLL、DLT_RAW 和 DLT_NULL。
+ * buffer 连 4 个表项都放不下时返回 -5。
+ */
+int custom_tcpdump_flow_init(struct custom_tcpdump_flow_table *table, void* buffer, size_t buffer_size, int linktype) {
+    size_t n = buffer_size / sizeof(struct custom_tcpdump_flow);
+    uint32_t capacity = 1;
+
+    if (n < 4) {
+        fprintf(stderr, "Error: buffer too small for a flow table\n");
+        return -5;
+    }
+    while ((size_t)capacity * 2 <= n && capacity < (1u << 31)) {
+        capacity *= 2;
+    }
+    memset(table, 0, sizeof(*table));
+    table->slots = (struct custom_tcpdump_flow *)buffer;
+    table->capacity = capacity;
+    table->limit = capacity / 4 * 3;
+    table->linktype = linktype;
+    memset(buffer, 0, (size_t)capacity * sizeof(struct custom_tcpdump_flow));
+    return 0;
+}
+
+// FNV-1a，键长固定，编译器会展开
+static inline uint32_t custom_tcpdump_flow_hash(const struct custom_tcpdump_flow_key *key) {
+    const uint8_t *p = (const uint8_t *)key;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < sizeof(*key); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static inline uint16_t custom_tcpdump_get_be16(const u_char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/*
+ * 从链路层开始解析到传输层，填好 key 并返回 TCP 标志（非 TCP 为 0）。
+ * 不是 IP 包或头部被截断时返回 -1。
+ */
+static int custom_tcpdump_flow_parse(int linktype, const u_char *p, uint32_t caplen,
+                                     struct custom_tcpdump_flow_key *key) {
+    const u_char *end = p + caplen;
+    uint16_t ethertype;
+    uint32_t family;
+    size_t hlen;
+    uint8_t proto;
+    int fragment = 0;
+
+    memset(key, 0, sizeof(*key));
+
+    // 1. 链路层
+    switch (linktype) {
+    case DLT_EN10MB:
+        if (caplen < 14) {
+            return -1;
+        }
+        ethertype = custom_tcpdump_get_be16(p + 12);
+        p += 14;
+        // 802.1Q / 802.1ad，可能有多层
+        while ((ethertype == 0x8100 || ethertype == 0x88a8) && end - p >= 4) {
+            ethertype = custom_tcpdump_get_be16(p + 2);
+            p += 4;
+        }
+        break;
+    case DLT_LINUX_SLL:
+        if (caplen < 16) {
+            return -1;
+        }
+        ethertype = custom_tcpdump_get_be16(p + 14);
+        p += 16;
+        break;
+    case DLT_NULL:
+        if (caplen < 4) {
+            return -1;
+        }
+        memcpy(&family, p, sizeof(family));  // 抓包主机字节序
+        ethertype = family == 2 ? 0x0800 : (family == 10 || family == 24 || family == 28 || family == 30) ? 0x86dd : 0;
+        p += 4;
+        break;
+    case DLT_RAW:
+        if (caplen < 1) {
+            return -1;
+        }
+        ethertype = (p[0] >> 4) == 6 ? 0x86dd : 0x0800;
+        break;
+    default:
+        return -1;
+    }
+
+    // 2. 网络层
+    if (ethertype == 0x0800) {
+        if (end - p < 20 || (p[0] >> 4) != 4 || (hlen = (size_t)(p[0] & 0x0f) * 4) < 20 || (size_t)(end - p) < hlen) {
+            return -1;
+        }
+        key->family = AF_INET;
+        proto = p[9];
+        memcpy(key->src, p + 12, 4);
+        memcpy(key->dst, p + 16, 4);
+        // 非首个分片没有传输层头
+        fragment = (custom_tcpdump_get_be16(p + 6) & 0x1fff) != 0;
+        p += hlen;
+    } else if (ethertype == 0x86dd) {
+        if (end - p < 40 || (p[0] >> 4) != 6) {
+            return -1;
+        }
+        key->family = AF_INET6;
+        proto = p[6];
+        memcpy(key->src, p + 8, 16);
+        memcpy(key->dst, p + 24, 16);
+        p += 40;
+        // 跳过扩展头，找到真正的上层协议
+        for (;;) {
+            if (proto == 0 || proto == 43 || proto == 60) {          // 逐跳、路由、目的选项
+                if (end - p < 8) {
+                    break;
+                }
+                proto = p[0];
+                p += ((size_t)p[1] + 1) * 8;
+            } else if (proto == 51) {                                // AH
+                if (end - p < 8) {
+                    break;
+                }
+                proto = p[0];
+                p += ((size_t)p[1] + 2) * 4;
+            } else if (proto == 44) {                                // 分片
+                if (end - p < 8) {
+                    break;
+                }
+                proto = p[0];
+                fragment = (custom_tcpdump_get_be16(p + 2) & 0xfff8) != 0;
+                p += 8;
+            } else {
+                break;
+            }
+            if (p > end) {
+                p = end;
+            }
+        }
+    } else {
+        return -1;
+    }
+    key->proto = proto;
+
+    // 3. 传输层，端口被截断时只按地址和协议聚合
+    if (fragment) {
+        return 0;
+    }
+    if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && end - p >= 4) {
+        key->sport = custom_tcpdump_get_be16(p);
+        key->dport = custom_tcpdump_get_be16(p + 2);
+    }
+    if (proto == IPPROTO_TCP && end - p >= 14) {
+        return p[13];
+    }
+    return 0;
+}
+
+/*
+ * 累计一个包。成功返回 0；不是 IP 包返回 -1；表已满、新流没能记录时返回 1。
+ */
+int custom_tcpdump_flow_add(struct custom_tcpdump_flow_table *table, const struct pcap_pkthdr *header,
+                            const u_char *packet) {
+    struct custom_tcpdump_flow_key key;
+    struct custom_tcpdump_flow *flow;
+    uint32_t mask = table->capacity - 1;
+    uint32_t hash, i;
+    int flags;
+
+    table->packets++;
+    if ((flags = custom_tcpdump_flow_parse(table->linktype, packet, header->caplen, &key)) < 0) {
+        table->not_ip++;
+        return -1;
+    }
+
+    // 线性探测，先比较哈希值再比较完整的键
+    hash = custom_tcpdump_flow_hash(&key);
+    for (i = hash & mask;; i = (i + 1) & mask) {
+        flow = &table->slots[i];
+        if (!flow->used) {
+            if (table->count >= table->limit) {
+                table->overflow++;
+                return 1;
+            }
+            flow->key = key;
+            flow->used = 1;
+            flow->hash = hash;
+            flow->first = header->ts;
+            table->count++;
+            break;
+        }
+        if (flow->hash == hash && memcmp(&flow->key, &key, sizeof(key)) == 0) {
+            break;
+        }
+    }
+
+    flow->packets++;
+    flow->bytes += header->len;
+    flow->last = header->ts;
+    if (flags) {
+        flow->fin += (flags & 0x01) != 0;
+        flow->syn += (flags & 0x02) != 0;
+        flow->rst += (flags & 0x04) != 0;
+        flow->psh += (flags & 0x08) != 0;
+        flow->ack += (flags & 0x10) != 0;
+        flow->urg += (flags & 0x20) != 0;
+    }
+    return 0;
+}
+
+// pcap_handler 形式的入口，user 指向 struct custom_tcpdump_flow_table
+void custom_tcpdump_flow_handler(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    custom_tcpdump_flow_add((struct custom_tcpdump_flow_table *)user, header, packet);
+}
+
+/*
+ * 把有效表项按槽位顺序移到 buffer 开头。之后表不能再继续使用。
+ */
+void custom_tcpdump_flow_finish(struct custom_tcpdump_flow_table *table, struct custom_tcpdump_flow_result *result) {
+    uint32_t i, n = 0;
+
+    for (i = 0; i < table->capacity; i++) {
+        if (table->slots[i].used) {
+            if (i != n) {
+                table->slots[n] = table->slots[i];
+            }
+            n++;
+        }
+    }
+
+    result->flow_count = n;
+    result->bytes_used = (size_t)n * sizeof(struct custom_tcpdump_flow);
+    result->packets = table->packets;
+    result->not_ip = table->not_ip;
+    result->overflow = table->overflow;
+}
+
+/*
+ * 批量引擎加流聚合：按 opts 的停止条件抓包，buffer 里返回流统计数组而不是包内容。
+ * session 可以为 NULL。错误码与 custom_tcpdump_run 一致。
+ */
+int custom_tcpdump_capture_flows(const char* iface, const char* custom_filter, const struct custom_tcpdump_options *opts,
+                                 struct custom_tcpdump_session *session, void* buffer, size_t buffer_size,
+                                 struct custom_tcpdump_flow_result *result, struct custom_tcpdump_stats *stats) {
+    struct custom_tcpdump_flow_table table;
+    pcap_t *handle;
+    int ret;
+
+    if ((ret = custom_tcpdump_open_ex(iface, custom_filter, opts, &handle)) != 0) {
+        return ret;
+    }
+    if ((ret = custom_tcpdump_flow_init(&table, buffer, buffer_size, pcap_datalink(handle))) != 0) {
+        pcap_close(handle);
+        return ret;
+    }
+    ret = custom_tcpdump_run_handle(handle, opts, session, custom_tcpdump_flow_handler, (u_char *)&table, stats);
+    custom_tcpdump_flow_finish(&table, result);
+    pcap_close(handle);
+    return ret;
+}
+
+#endif // CUSTOM_TCPDUMP_FLOW_H
@@ -0,0 +1,283 @@
+#ifndef CUSTOM_TCPDUMP_RECORDS_H
+#define CUSTOM_TCPDUMP_RECORDS_H
+
+#include "custom_tcpdump.h"
+#include <stdint.h>
+
+/*
+ * 带记录头的抓包缓冲区格式。
+ *
+ * 缓冲区布局：
+ *   [文件头][记录 0][记录 1]...[记录 N-1][索引: N 个 uint64 偏移][尾部 footer]
+ *
+ * 文件头和记录采用 pcap 或 pcapng 布局，每条记录带时间戳、线上长度和抓取长度，
+ * 前 records_bytes 字节本身就是一个合法的 pcap/pcapng 文件。
+ * 索引和 footer 追加在后面，下游工具读最后 16 字节即可找到索引，
+ * 再用一次数组访问定位第 N 个包，不需要从头解析。
+ */
+
+#define CUSTOM_TCPDUMP_FORMAT_PCAP   0
+#define CUSTOM_TCPDUMP_FORMAT_PCAPNG 1
+
+#define CUSTOM_TCPDUMP_INDEX_MAGIC 0x58495443u  // "CTIX"
+
+struct custom_tcpdump_index_footer {
+    uint64_t index_offset;  // 索引相对缓冲区起始的偏移
+    uint32_t record_count;
+    uint32_t magic;
+};
+
+struct custom_tcpdump_result {
+    uint32_t record_count;  // 写入的包数
+    size_t records_bytes;   // 文件头加全部记录的字节数
+    size_t bytes_used;      // 包括索引和 footer 在内的总字节数
+};
+
+struct custom_tcpdump_records {
+    u_char *buffer;
+    size_t buffer_size;
+    size_t offset;          // 下一条记录的写入位置
+    size_t index_low;       // 索引从缓冲区尾部向低地址增长，这是当前最低位置
+    uint32_t count;
+    int format;
+    int full;
+    pcap_t *handle;         // 非 NULL 时缓冲区写满后调用 pcap_breakloop
+};
+
+static inline void custom_tcpdump_put_u16(u_char *p, uint16_t v) { memcpy(p, &v, sizeof(v)); }
+static inline void custom_tcpdump_put_u32(u_char *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+static inline void custom_tcpdump_put_u64(u_char *p, uint64_t v) { memcpy(p, &v, sizeof(v)); }
+
+// 记录在缓冲区中占用的字节数
+static inline size_t custom_tcpdump_record_size(int format, uint32_t caplen) {
+    if (format == CUSTOM_TCPDUMP_FORMAT_PCAPNG) {
+        // Enhanced Packet Block: 28 字节头 + 按 4 字节对齐的数据 + 4 字节尾部长度
+        return 32 + (((size_t)caplen + 3) & ~(size_t)3);
+    }
+    return 16 + caplen;
+}
+
+/*
+ * 初始化缓冲区并写入文件头。
+ * 缓冲区连文件头和 footer 都放不下时返回 -5。
+ */
+int custom_tcpdump_records_init(struct custom_tcpdump_records *rec, void* buffer, size_t buffer_size,
+                                int format, int linktype, int snaplen) {
+    size_t header_size = (format == CUSTOM_TCPDUMP_FORMAT_PCAPNG) ? 28 + 20 : 24;
+    u_char *p = (u_char *)buffer;
+
+    memset(rec, 0, sizeof(*rec));
+    if (buffer_size < header_size + sizeof(struct custom_tcpdump_index_footer)) {
+        fprintf(stderr, "Error: buffer too small for capture header\n");
+        return -5;
+    }
+    rec->buffer = p;
+    rec->buffer_size = buffer_size;
+    rec->format = format;
+    rec->index_low = buffer_size - sizeof(struct custom_tcpdump_index_footer);
+
+    if (format == CUSTOM_TCPDUMP_FORMAT_PCAPNG) {
+        // Section Header Block
+        custom_tcpdump_put_u32(p, 0x0A0D0D0A);
+        custom_tcpdump_put_u32(p + 4, 28);
+        custom_tcpdump_put_u32(p + 8, 0x1A2B3C4D);
+        custom_tcpdump_put_u16(p + 12, 1);
+        custom_tcpdump_put_u16(p + 14, 0);
+        custom_tcpdump_put_u64(p + 16, UINT64_MAX);  // section 长度未知
+        custom_tcpdump_put_u32(p + 24, 28);
+        // Interface Description Block，时间戳精度使用默认的微秒
+        p += 28;
+        custom_tcpdump_put_u32(p, 1);
+        custom_tcpdump_put_u32(p + 4, 20);
+        custom_tcpdump_put_u16(p + 8, (uint16_t)linktype);
+        custom_tcpdump_put_u16(p + 10, 0);
+        custom_tcpdump_put_u32(p + 12, (uint32_t)snaplen);
+        custom_tcpdump_put_u32(p + 16, 20);
+    } else {
+        custom_tcpdump_put_u32(p, 0xA1B2C3D4);
+        custom_tcpdump_put_u16(p + 4, 2);
+        custom_tcpdump_put_u16(p + 6, 4);
+        custom_tcpdump_put_u32(p + 8, 0);    // thiszone
+        custom_tcpdump_put_u32(p + 12, 0);   // sigfigs
+        custom_tcpdump_put_u32(p + 16, (uint32_t)snaplen);
+        custom_tcpdump_put_u32(p + 20, (uint32_t)linktype);
+    }
+    rec->offset = header_size;
+    return 0;
+}
+
+/*
+ * 追加一条记录，同时在缓冲区尾部记下它的偏移。
+ * 成功返回 0；放不下时返回 1 并设置 full，已写入的内容保持不变。
+ */
+int custom_tcpdump_records_append(struct custom_tcpdump_records *rec, const struct pcap_pkthdr *header,
+                                  const u_char *packet) {
+    size_t size = custom_tcpdump_record_size(rec->format, header->caplen);
+    u_char *p = rec->buffer + rec->offset;
+    uint64_t ts;
+
+    if (rec->index_low - rec->offset < sizeof(uint64_t) ||
+        size > rec->index_low - rec->offset - sizeof(uint64_t)) {
+        rec->full = 1;
+        return 1;
+    }
+
+    if (rec->format == CUSTOM_TCPDUMP_FORMAT_PCAPNG) {
+        ts = (uint64_t)header->ts.tv_sec * 1000000u + (uint64_t)header->ts.tv_usec;
+        custom_tcpdump_put_u32(p, 6);
+        custom_tcpdump_put_u32(p + 4, (uint32_t)size);
+        custom_tcpdump_put_u32(p + 8, 0);  // interface id
+        custom_tcpdump_put_u32(p + 12, (uint32_t)(ts >> 32));
+        custom_tcpdump_put_u32(p + 16, (uint32_t)ts);
+        custom_tcpdump_put_u32(p + 20, header->caplen);
+        custom_tcpdump_put_u32(p + 24, header->len);
+        memcpy(p + 28, packet, header->caplen);
+        memset(p + 28 + header->caplen, 0, size - 32 - header->caplen);
+        custom_tcpdump_put_u32(p + size - 4, (uint32_t)size);
+    } else {
+        custom_tcpdump_put_u32(p, (uint32_t)header->ts.tv_sec);
+        custom_tcpdump_put_u32(p + 4, (uint32_t)header->ts.tv_usec);
+        custom_tcpdump_put_u32(p + 8, header->caplen);
+        custom_tcpdump_put_u32(p + 12, header->len);
+        memcpy(p + 16, packet, header->caplen);
+    }
+
+    rec->index_low -= sizeof(uint64_t);
+    custom_tcpdump_put_u64(rec->buffer + rec->index_low, rec->offset);
+    rec->offset += size;
+    rec->count++;
+    return 0;
+}
+
+// pcap_handler 形式的入口，user 指向 struct custom_tcpdump_records
+void custom_tcpdump_records_handler(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct custom_tcpdump_records *rec = (struct custom_tcpdump_records *)user;
+
+    if (custom_tcpdump_records_append(rec, header, packet) != 0 && rec->handle != NULL) {
+        pcap_breakloop(rec->handle);
+    }
+}
+
+/*
+ * 把尾部逆序增长的索引翻转并移到最后一条记录之后，再写 footer。
+ */
+void custom_tcpdump_records_finish(struct custom_tcpdump_records *rec, struct custom_tcpdump_result *result) {
+    size_t index_bytes = (size_t)rec->count * sizeof(uint64_t);
+    u_char *index = rec->buffer + rec->index_low;
+    u_char tmp[sizeof(uint64_t)];
+    struct custom_tcpdump_index_footer footer;
+    uint32_t i, j;
+
+    for (i = 0, j = rec->count; i + 1 < j; i++, j--) {
+        memcpy(tmp, index + (size_t)i * sizeof(uint64_t), sizeof(tmp));
+        memcpy(index + (size_t)i * sizeof(uint64_t), index + (size_t)(j - 1) * sizeof(uint64_t), sizeof(tmp));
+        memcpy(index + (size_t)(j - 1) * sizeof(uint64_t), tmp, sizeof(tmp));
+    }
+    memmove(rec->buffer + rec->offset, rec->buffer + rec->index_low, index_bytes);
+
+    footer.index_offset = rec->offset;
+    footer.record_count = rec->count;
+    footer.magic = CUSTOM_TCPDUMP_INDEX_MAGIC;
+    memcpy(rec->buffer + rec->offset + index_bytes, &footer, sizeof(footer));
+
+    result->record_count = rec->count;
+    result->records_bytes = rec->offset;
+    result->bytes_used = rec->offset + index_bytes + sizeof(footer);
+}
+
+/*
+ * 在 custom_tcpdump_records_finish 产生的缓冲区中 O(1) 定位第 n 个包。
+ * 成功返回 0 并填好 header 和 packet（指向 buffer 内部）；越界或格式不对返回 -1。
+ * footer、索引和记录里的偏移、长度都先与 bytes_used 核对，截断或损坏的缓冲区不会越界读。
+ */
+int custom_tcpdump_records_get(const void* buffer, size_t bytes_used, uint32_t n,
+                               struct pcap_pkthdr *header, const u_char **packet) {
+    const u_char *base = (const u_char *)buffer;
+    struct custom_tcpdump_index_footer footer;
+    const u_char *p;
+    uint64_t offset, ts, index_end;
+    uint32_t v[4], type;
+    size_t hdr_len;
+
+    if (bytes_used < sizeof(footer) + sizeof(type)) {
+        return -1;
+    }
+    memcpy(&footer, base + bytes_used - sizeof(footer), sizeof(footer));
+    if (footer.magic != CUSTOM_TCPDUMP_INDEX_MAGIC || n >= footer.record_count) {
+        return -1;
+    }
+    // 索引必须完整落在 footer 之前，record_count 不超过 2^32，乘 8 不会溢出 uint64_t
+    index_end = bytes_used - sizeof(footer);
+    if (footer.index_offset > index_end ||
+        (uint64_t)footer.record_count * sizeof(uint64_t) > index_end - footer.index_offset) {
+        return -1;
+    }
+    memcpy(&offset, base + footer.index_offset + (size_t)n * sizeof(uint64_t), sizeof(offset));
+    memcpy(&type, base, sizeof(type));
+
+    // 记录头和包数据都必须在索引之前
+    hdr_len = (type == 0x0A0D0D0A) ? 28 : 16;
+    if (offset > footer.index_offset || hdr_len > footer.index_offset - offset) {
+        return -1;
+    }
+    p = base + offset;
+
+    if (type == 0x0A0D0D0A) {
+        memcpy(v, p + 12, sizeof(v));
+        ts = ((uint64_t)v[0] << 32) | v[1];
+        header->ts.tv_sec = (time_t)(ts / 1000000u);
+        header->ts.tv_usec = (suseconds_t)(ts % 1000000u);
+        header->caplen = v[2];
+        header->len = v[3];
+        *packet = p + 28;
+    } else {
+        memcpy(v, p, sizeof(v));
+        header->ts.tv_sec = v[0];
+        header->ts.tv_usec = v[1];
+        header->caplen = v[2];
+        header->len = v[3];
+        *packet = p + 16;
+    }
+    if (header->caplen > footer.index_offset - offset - hdr_len) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * 与 custom_tcpdump_capture 相同的抓包流程，但输出带记录头和索引的格式。
+ * 成功返回 0，包数和占用字节数通过 result 返回；缓冲区写满时正常结束。
+ */
+int custom_tcpdump_capture_records(const char* iface, const char* custom_filter, int format,
+                                   void* buffer, size_t buffer_size, struct custom_tcpdump_result *result) {
+    struct custom_tcpdump_records rec;
+    pcap_t *handle;
+    int snaplen = 65535;
+    int promisc = 1;
+    int timeout_ms = 1000;
+    int ret;
+
+    if ((ret = custom_tcpdump_open_live(iface, custom_filter, snaplen, promisc, timeout_ms, &handle)) != 0) {
+        return ret;
+    }
+    if ((ret = custom_tcpdump_records_init(&rec, buffer, buffer_size, format, pcap_datalink(handle), snaplen)) != 0) {
+        pcap_close(handle);
+        return ret;
+    }
+
+    // 抓包循环，遇到超时或缓冲区写满时停止
+    const u_char *packet;
+    struct pcap_pkthdr header;
+    while ((packet = pcap_next(handle, &header)) != NULL) {
+        if (custom_tcpdump_records_append(&rec, &header, packet) != 0) {
+            fprintf(stderr, "Buffer is full, stopping capture.\n");
+            break;
+        }
+    }
+
+    custom_tcpdump_records_finish(&rec, result);
+    pcap_close(handle);
+    return 0;
+}
+
+#endif // CUSTOM_TCPDUMP_RECORDS_H
@@ -0,0 +1,311 @@
+#ifndef CUSTOM_TCPDUMP_RING_H
+#define CUSTOM_TCPDUMP_RING_H
+
+#include <pcap.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+/*
+ * 基于 AF_PACKET TPACKET_V3 的零拷贝抓包引擎。
+ * 内核把数据包直接写进与用户态共享的 mmap 块环，一个块里有多个包，
+ * 调用者拿到的是整个块的只读视图，处理完再把块还给内核，中间没有 memcpy。
+ */
+
+struct custom_tcpdump_ring_config {
+    unsigned int block_size;     // 每个块的字节数，必须是页大小的整数倍
+    unsigned int block_nr;       // 块的数量
+    unsigned int frame_size;     // TPACKET_V3 只用于校验，包按实际长度紧凑排列
+    unsigned int retire_tov_ms;  // 块未写满时最多等待多久交给用户态
+    int snaplen;                 // 编译过滤规则时使用的抓包长度
+    int promisc;
+};
+
+#define CUSTOM_TCPDUMP_RING_CONFIG_DEFAULT { \
+    .block_size = 1 << 22,                   \
+    .block_nr = 64,                          \
+    .frame_size = 2048,                      \
+    .retire_tov_ms = 60,                     \
+    .snaplen = 65535,                        \
+    .promisc = 1,                            \
+}
+
+struct custom_tcpdump_ring {
+    int fd;
+    int linktype;                // 由接口硬件类型推出的 DLT_*，块里的包都是这种链路层
+    uint8_t *map;
+    size_t map_size;
+    struct tpacket_req3 req;
+    unsigned int current_block;
+};
+
+// 一个已经交给用户态的块，desc 指向 mmap 区域，释放前一直有效
+struct custom_tcpdump_block {
+    struct tpacket_block_desc *desc;
+    uint32_t num_pkts;
+};
+
+static inline const struct tpacket3_hdr *custom_tcpdump_block_first(const struct custom_tcpdump_block *blk) {
+    return (const struct tpacket3_hdr *)((const uint8_t *)blk->desc + blk->desc->hdr.bh1.offset_to_first_pkt);
+}
+
+static inline const struct tpacket3_hdr *custom_tcpdump_block_next(const struct tpacket3_hdr *pkt) {
+    return (const struct tpacket3_hdr *)((const uint8_t *)pkt + pkt->tp_next_offset);
+}
+
+static inline const u_char *custom_tcpdump_pkt_data(const struct tpacket3_hdr *pkt) {
+    return (const u_char *)pkt + pkt->tp_mac;
+}
+
+/*
+ * 按接口的 ARPHRD_* 类型得到 SOCK_RAW 套接字上看到的链路层类型（DLT_*）。
+ * 只支持过滤规则和下游解析都认识的几种，其余返回 -1。
+ */
+int custom_tcpdump_ring_linktype(int fd, const char* iface) {
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (strlen(iface) >= sizeof(ifr.ifr_name)) {
+        errno = ENODEV;
+        return -1;
+    }
+    strcpy(ifr.ifr_name, iface);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) == -1) {
+        return -1;
+    }
+    switch (ifr.ifr_hwaddr.sa_family) {
+    case ARPHRD_ETHER:
+    case ARPHRD_LOOPBACK:   // lo 上的包带全零 MAC 的以太网头
+        return DLT_EN10MB;
+    case ARPHRD_NONE:       // tun 等三层设备，包直接从 IP 头开始
+#ifdef ARPHRD_RAWIP
+    case ARPHRD_RAWIP:
+#endif
+        return DLT_RAW;
+    default:
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+}
+
+/*
+ * 用 libpcap 把过滤表达式编译成经典 BPF，再通过 SO_ATTACH_FILTER 挂到套接字上，
+ * 与 custom_tcpdump_capture 接受同样的过滤字符串。
+ * linktype 必须与套接字上实际收到的链路层一致，否则规则里的偏移全部对不上。
+ */
+int custom_tcpdump_attach_filter(int fd, const char* custom_filter, int linktype, int snaplen) {
+    struct bpf_program bpf;
+    struct sock_fprog fprog;
+    pcap_t *dead;
+
+    if (custom_filter == NULL || strlen(custom_filter) == 0) {
+        return 0;
+    }
+
+    if ((dead = pcap_open_dead(linktype, snaplen)) == NULL) {
+        fprintf(stderr, "Error: pcap_open_dead failed\n");
+        return -2;
+    }
+    if (pcap_compile(dead, &bpf, custom_filter, 1, PCAP_NETMASK_UNKNOWN) == -1) {
+        fprintf(stderr, "Error: bad filter \"%s\" - %s\n", custom_filter, pcap_geterr(dead));
+        pcap_close(dead);
+        return -2;
+    }
+
+    // libpcap 的 bpf_insn 与内核的 sock_filter 布局相同
+    fprog.len = bpf.bf_len;
+    fprog.filter = (struct sock_filter *)bpf.bf_insns;
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == -1) {
+        fprintf(stderr, "Error: cannot set filter \"%s\" - %s\n", custom_filter, strerror(errno));
+        pcap_freecode(&bpf);
+        pcap_close(dead);
+        return -3;
+    }
+    pcap_freecode(&bpf);
+    pcap_close(dead);
+    return 0;
+}
+
+/*
+ * 打开接口上的 TPACKET_V3 环。config 为 NULL 时使用默认配置。
+ * 返回值与 custom_tcpdump_capture 一致：-1 打开失败（包括不支持的链路层类型），
+ * -2/-3 过滤规则错误，-4 环形缓冲区设置失败。
+ */
+int custom_tcpdump_ring_open(struct custom_tcpdump_ring *ring, const char* iface, const char* custom_filter,
+                             const struct custom_tcpdump_ring_config *config) {
+    static const struct custom_tcpdump_ring_config default_config = CUSTOM_TCPDUMP_RING_CONFIG_DEFAULT;
+    struct sockaddr_ll sll;
+    struct packet_mreq mreq;
+    int version = TPACKET_V3;
+    int ret;
+
+    if (config == NULL) {
+        config = &default_config;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    // 1. 创建套接字，协议先设为 0，bind 之前不接收任何包
+    if ((ring->fd = socket(AF_PACKET, SOCK_RAW, 0)) == -1) {
+        fprintf(stderr, "Error: cannot open packet socket - %s\n", strerror(errno));
+        return -1;
+    }
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1) {
+        fprintf(stderr, "Error: TPACKET_V3 not supported - %s\n", strerror(errno));
+        ret = -4;
+        goto fail;
+    }
+    if ((ring->linktype = custom_tcpdump_ring_linktype(ring->fd, iface)) == -1) {
+        fprintf(stderr, "Error: cannot use device %s - %s\n", iface, strerror(errno));
+        ret = -1;
+        goto fail;
+    }
+
+    // 2. 先挂过滤规则，避免环里混进不需要的包
+    if ((ret = custom_tcpdump_attach_filter(ring->fd, custom_filter, ring->linktype, config->snaplen)) != 0) {
+        goto fail;
+    }
+
+    // 3. 建立块环并映射到用户态
+    ring->req.tp_block_size = config->block_size;
+    ring->req.tp_block_nr = config->block_nr;
+    ring->req.tp_frame_size = config->frame_size;
+    ring->req.tp_frame_nr = (config->block_size / config->frame_size) * config->block_nr;
+    ring->req.tp_retire_blk_tov = config->retire_tov_ms;
+    ring->req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &ring->req, sizeof(ring->req)) == -1) {
+        fprintf(stderr, "Error: cannot set up rx ring - %s\n", strerror(errno));
+        ret = -4;
+        goto fail;
+    }
+    ring->map_size = (size_t)ring->req.tp_block_size * ring->req.tp_block_nr;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        fprintf(stderr, "Error: cannot mmap rx ring - %s\n", strerror(errno));
+        ret = -4;
+        goto fail;
+    }
+
+    // 4. 绑定到接口，开始接收
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = if_nametoindex(iface);
+    if (sll.sll_ifindex == 0 || bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+        fprintf(stderr, "Error: cannot open device %s - %s\n", iface, strerror(errno));
+        ret = -1;
+        goto fail;
+    }
+    if (config->promisc) {
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = sll.sll_ifindex;
+        mreq.mr_type = PACKET_MR_PROMISC;
+        if (setsockopt(ring->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1) {
+            fprintf(stderr, "Warning: could not set promiscuous mode on %s, %s\n", iface, strerror(errno));
+        }
+    }
+    return 0;
+
+fail:
+    if (ring->map != NULL) {
+        munmap(ring->map, ring->map_size);
+    }
+    close(ring->fd);
+    ring->fd = -1;
+    return ret;
+}
+
+/*
+ * 等待下一个块交给用户态。返回 1 表示 blk 有效，0 表示超时，-1 表示出错。
+ * timeout_ms 为 -1 时一直等待。
+ */
+int custom_tcpdump_ring_next_block(struct custom_tcpdump_ring *ring, struct custom_tcpdump_block *blk, int timeout_ms) {
+    struct tpacket_block_desc *desc =
+        (struct tpacket_block_desc *)(ring->map + (size_t)ring->current_block * ring->req.tp_block_size);
+    struct pollfd pfd;
+    int ret;
+
+    while ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+        pfd.fd = ring->fd;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, timeout_ms);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error: poll on rx ring failed - %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    blk->desc = desc;
+    blk->num_pkts = desc->hdr.bh1.num_pkts;
+    return 1;
+}
+
+// 处理完一个块后还给内核，之后不能再访问其中的数据
+void custom_tcpdump_ring_release_block(struct custom_tcpdump_ring *ring, struct custom_tcpdump_block *blk) {
+    __atomic_store_n(&blk->desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    blk->desc = NULL;
+    blk->num_pkts = 0;
+    ring->current_block = (ring->current_block + 1) % ring->req.tp_block_nr;
+}
+
+/*
+ * 取一个块，把其中每个包以 pcap_handler 的形式交给回调，再释放块。
+ * 方便复用按 pcap 回调编写的处理逻辑。返回处理的包数，超时返回 0，出错返回 -1。
+ */
+int custom_tcpdump_ring_dispatch(struct custom_tcpdump_ring *ring, int timeout_ms, pcap_handler callback, u_char *user) {
+    struct custom_tcpdump_block blk;
+    const struct tpacket3_hdr *pkt;
+    struct pcap_pkthdr header;
+    uint32_t i;
+    int ret;
+
+    if ((ret = custom_tcpdump_ring_next_block(ring, &blk, timeout_ms)) <= 0) {
+        return ret;
+    }
+    pkt = custom_tcpdump_block_first(&blk);
+    for (i = 0; i < blk.num_pkts; i++) {
+        header.ts.tv_sec = pkt->tp_sec;
+        header.ts.tv_usec = pkt->tp_nsec / 1000;
+        header.caplen = pkt->tp_snaplen;
+        header.len = pkt->tp_len;
+        callback(user, &header, custom_tcpdump_pkt_data(pkt));
+        pkt = custom_tcpdump_block_next(pkt);
+    }
+    ret = (int)blk.num_pkts;
+    custom_tcpdump_ring_release_block(ring, &blk);
+    return ret;
+}
+
+void custom_tcpdump_ring_close(struct custom_tcpdump_ring *ring) {
+    if (ring->map != NULL) {
+        munmap(ring->map, ring->map_size);
+        ring->map = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+
+#endif // CUSTOM_TCPDUMP_RING_H
@@ -0,0 +1,426 @@
+#ifndef CUSTOM_TCPDUMP_ROTATE_H
+#define CUSTOM_TCPDUMP_ROTATE_H
+
+#include "custom_tcpdump_engine.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * 流式写盘的抓包输出：包直接写进 mmap 映射的 pcap 文件段，
+ * 段写满或跨过时间间隔后切换到下一个文件，抓包不受调用者缓冲区大小限制。
+ *
+ * 每个段创建时用 posix_fallocate 预分配，写入只是内存拷贝。
+ * 写满的段交给后台线程收尾（munmap、截掉多余的预分配空间、fsync、close），
+ * 后台线程同时预先准备好下一个段，抓包线程切换文件时不需要等磁盘。
+ *
+ * 文件名为 <prefix>.<序号>.pcap，序号从 0 开始递增，每个文件都是完整的 pcap 文件。
+ */
+
+struct custom_tcpdump_rotate_config {
+    const char *prefix;     // 文件路径前缀，需在 sink 关闭前保持有效
+    size_t segment_size;    // 单个文件的最大字节数
+    uint64_t rotate_ms;     // 按包时间戳计算的单个文件最长跨度，0 表示只按大小切换
+    int linktype;
+    int snaplen;
+};
+
+#define CUSTOM_TCPDUMP_ROTATE_CONFIG_DEFAULT { \
+    .prefix = "capture",                       \
+    .segment_size = (size_t)256 << 20,         \
+    .rotate_ms = 0,                            \
+    .linktype = DLT_EN10MB,                    \
+    .snaplen = 65535,                          \
+}
+
+#define CUSTOM_TCPDUMP_PCAP_HEADER_SIZE 24
+#define CUSTOM_TCPDUMP_PCAP_RECORD_HEADER_SIZE 16
+
+struct custom_tcpdump_segment {
+    struct custom_tcpdump_segment *next;
+    int fd;
+    u_char *map;
+    size_t size;
+    size_t offset;          // 已写入的字节数，收尾时文件截断到这个长度
+    uint64_t first_ts_ms;
+    unsigned int seq;
+    char path[PATH_MAX];
+};
+
+struct custom_tcpdump_rotate {
+    struct custom_tcpdump_rotate_config config;
+    struct custom_tcpdump_segment *current;
+    pcap_t *handle;         // 非 NULL 时写盘出错后调用 pcap_breakloop
+
+    // 以下字段由 lock 保护，与后台线程共享
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t spare_cond;  // 后台线程打开完一个空闲段（成功或失败）时广播
+    pthread_t thread;
+    struct custom_tcpdump_segment *retire_head;
+    struct custom_tcpdump_segment *retire_tail;
+    struct custom_tcpdump_segment *spare;
+    unsigned int next_seq;
+    int opening;            // 后台线程已经取走序号、正在打开空闲段
+    int stopping;
+
+    // 后台线程和抓包线程都可能置位，用 __atomic 读写；置位后 append 一律失败，抓包随之停止
+    int error;
+
+    uint64_t packets;
+    uint64_t bytes;
+    unsigned int segments;  // 已经打开过的段数
+};
+
+static void custom_tcpdump_rotate_set_error(struct custom_tcpdump_rotate *r) {
+    __atomic_store_n(&r->error, 1, __ATOMIC_RELEASE);
+}
+
+static int custom_tcpdump_rotate_failed(const struct custom_tcpdump_rotate *r) {
+    return __atomic_load_n(&r->error, __ATOMIC_ACQUIRE);
+}
+
+// 创建并预分配一个段，写好 pcap 文件头。失败返回 NULL
+static struct custom_tcpdump_segment *custom_tcpdump_segment_open(const struct custom_tcpdump_rotate_config *config,
+                                                                  unsigned int seq) {
+    struct custom_tcpdump_segment *seg;
+    u_char *p;
+    int err;
+
+    if ((seg = calloc(1, sizeof(*seg))) == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    seg->seq = seq;
+    seg->size = config->segment_size;
+    seg->offset = CUSTOM_TCPDUMP_PCAP_HEADER_SIZE;
+    snprintf(seg->path, sizeof(seg->path), "%s.%06u.pcap", config->prefix, seq);
+
+    if ((seg->fd = open(seg->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        fprintf(stderr, "Error: cannot create %s - %s\n", seg->path, strerror(errno));
+        free(seg);
+        return NULL;
+    }
+    // glibc 在支持的文件系统上直接调用 fallocate，只分配块不写数据
+    if ((err = posix_fallocate(seg->fd, 0, (off_t)seg->size)) != 0) {
+        fprintf(stderr, "Error: cannot preallocate %s - %s\n", seg->path, strerror(err));
+        goto fail;
+    }
+    seg->map = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+    if (seg->map == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot mmap %s - %s\n", seg->path, strerror(errno));
+        goto fail;
+    }
+    madvise(seg->map, seg->size, MADV_SEQUENTIAL);
+
+    // pcap 文件头，微秒时间戳，本机字节序
+    p = seg->map;
+    custom_tcpdump_put_u32(p, 0xa1b2c3d4);
+    custom_tcpdump_put_u16(p + 4, 2);
+    custom_tcpdump_put_u16(p + 6, 4);
+    custom_tcpdump_put_u32(p + 8, 0);
+    custom_tcpdump_put_u32(p + 12, 0);
+    custom_tcpdump_put_u32(p + 16, (uint32_t)config->snaplen);
+    custom_tcpdump_put_u32(p + 20, (uint32_t)config->linktype);
+    return seg;
+
+fail:
+    close(seg->fd);
+    unlink(seg->path);
+    free(seg);
+    return NULL;
+}
+
+// 收尾一个段：解除映射，截掉未使用的预分配空间，落盘后关闭。返回 0 或 -1
+static int custom_tcpdump_segment_close(struct custom_tcpdump_segment *seg) {
+    int ret = 0;
+
+    munmap(seg->map, seg->size);
+    if (ftruncate(seg->fd, (off_t)seg->offset) == -1 || fsync(seg->fd) == -1) {
+        fprintf(stderr, "Error: cannot finish %s - %s\n", seg->path, strerror(errno));
+        ret = -1;
+    }
+    close(seg->fd);
+    free(seg);
+    return ret;
+}
+
+// 后台线程：收尾写满的段，并保证总有一个预先打开的空闲段
+static void *custom_tcpdump_rotate_thread(void *arg) {
+    struct custom_tcpdump_rotate *r = (struct custom_tcpdump_rotate *)arg;
+    struct custom_tcpdump_segment *seg, *spare;
+    unsigned int seq;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (r->retire_head == NULL && r->spare != NULL && !r->stopping) {
+            pthread_cond_wait(&r->cond, &r->lock);
+        }
+
+        if ((seg = r->retire_head) != NULL) {
+            r->retire_head = seg->next;
+            if (r->retire_head == NULL) {
+                r->retire_tail = NULL;
+            }
+            pthread_mutex_unlock(&r->lock);
+            if (custom_tcpdump_segment_close(seg) != 0) {
+                custom_tcpdump_rotate_set_error(r);
+            }
+            pthread_mutex_lock(&r->lock);
+            continue;
+        }
+        if (r->stopping) {
+            break;
+        }
+
+        // 没有待收尾的段，准备下一个空闲段
+        seq = r->next_seq++;
+        r->opening = 1;
+        pthread_mutex_unlock(&r->lock);
+        spare = custom_tcpdump_segment_open(&r->config, seq);
+        pthread_mutex_lock(&r->lock);
+        r->opening = 0;
+        pthread_cond_broadcast(&r->spare_cond);
+        if (spare == NULL) {
+            // 预先创建失败同样算写盘出错，抓包从下一个包开始停止，这里不再反复失败
+            custom_tcpdump_rotate_set_error(r);
+            r->stopping = 1;
+            break;
+        }
+        r->spare = spare;
+    }
+
+    // 退出前删除没用上的空闲段
+    spare = r->spare;
+    r->spare = NULL;
+    pthread_mutex_unlock(&r->lock);
+    if (spare != NULL) {
+        munmap(spare->map, spare->size);
+        close(spare->fd);
+        unlink(spare->path);
+        free(spare);
+    }
+    return NULL;
+}
+
+/*
+ * 切换到下一个段：当前段交给后台线程收尾，优先使用预先打开的空闲段。
+ * 后台线程正在打开空闲段时等它打开完，它已经取走了下一个序号，
+ * 抓包线程另取序号会让文件编号和抓包顺序不一致；后台线程没有在准备时
+ * 才在抓包线程里同步创建。失败返回 -1。
+ */
+static int custom_tcpdump_rotate_next(struct custom_tcpdump_rotate *r) {
+    struct custom_tcpdump_segment *old = r->current;
+    struct custom_tcpdump_segment *seg;
+    unsigned int seq = 0;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->spare == NULL && r->opening) {
+        pthread_cond_wait(&r->spare_cond, &r->lock);
+    }
+    if ((seg = r->spare) != NULL) {
+        r->spare = NULL;
+    } else {
+        seq = r->next_seq++;
+    }
+    old->next = NULL;
+    if (r->retire_tail != NULL) {
+        r->retire_tail->next = old;
+    } else {
+        r->retire_head = old;
+    }
+    r->retire_tail = old;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    if (seg == NULL && (seg = custom_tcpdump_segment_open(&r->config, seq)) == NULL) {
+        r->current = NULL;
+        custom_tcpdump_rotate_set_error(r);
+        return -1;
+    }
+    r->current = seg;
+    r->segments++;
+    return 0;
+}
+
+/*
+ * 打开第一个段并启动后台线程。config 为 NULL 时使用默认配置。
+ * segment_size 太小放不下一个 snaplen 长度的包时会自动调大。
+ * 成功返回 0，失败返回 -1。
+ */
+int custom_tcpdump_rotate_open(struct custom_tcpdump_rotate *r, const struct custom_tcpdump_rotate_config *config) {
+    static const struct custom_tcpdump_rotate_config default_config = CUSTOM_TCPDUMP_ROTATE_CONFIG_DEFAULT;
+    size_t min_size;
+
+    memset(r, 0, sizeof(*r));
+    r->config = config != NULL ? *config : default_config;
+    min_size = CUSTOM_TCPDUMP_PCAP_HEADER_SIZE + CUSTOM_TCPDUMP_PCAP_RECORD_HEADER_SIZE + (size_t)r->config.snaplen;
+    if (r->config.segment_size < min_size) {
+        r->config.segment_size = min_size;
+    }
+
+    if ((r->current = custom_tcpdump_segment_open(&r->config, 0)) == NULL) {
+        return -1;
+    }
+    r->next_seq = 1;
+    r->segments = 1;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    pthread_cond_init(&r->spare_cond, NULL);
+    if (pthread_create(&r->thread, NULL, custom_tcpdump_rotate_thread, r) != 0) {
+        fprintf(stderr, "Error: cannot create writer thread\n");
+        custom_tcpdump_segment_close(r->current);
+        r->current = NULL;
+        pthread_cond_destroy(&r->spare_cond);
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * 追加一个包，必要时切换文件。超过 snaplen 的部分被截断。
+ * 成功返回 0，写盘出错返回 -1，之后的调用都会直接失败。
+ * 后台线程收尾某个段失败（close/fsync 出错）也算写盘出错，从下一个包开始生效。
+ */
+int custom_tcpdump_rotate_append(struct custom_tcpdump_rotate *r, const struct pcap_pkthdr *header,
+                                 const u_char *packet) {
+    struct custom_tcpdump_segment *seg = r->current;
+    uint32_t caplen = header->caplen;
+    uint64_t ts_ms = (uint64_t)header->ts.tv_sec * 1000 + (uint64_t)header->ts.tv_usec / 1000;
+    size_t size;
+    u_char *p;
+
+    if (seg == NULL || custom_tcpdump_rotate_failed(r)) {
+        return -1;
+    }
+    if (caplen > (uint32_t)r->config.snaplen) {
+        caplen = (uint32_t)r->config.snaplen;
+    }
+    size = CUSTOM_TCPDUMP_PCAP_RECORD_HEADER_SIZE + caplen;
+
+    // 段里已经有包时才考虑切换，保证每个文件至少有一个包
+    if (seg->offset > CUSTOM_TCPDUMP_PCAP_HEADER_SIZE &&
+        (size > seg->size - seg->offset ||
+         (r->config.rotate_ms && ts_ms >= seg->first_ts_ms + r->config.rotate_ms))) {
+        if (custom_tcpdump_rotate_next(r) != 0) {
+            return -1;
+        }
+        seg = r->current;
+    }
+    if (seg->offset == CUSTOM_TCPDUMP_PCAP_HEADER_SIZE) {
+        seg->first_ts_ms = ts_ms;
+    }
+
+    p = seg->map + seg->offset;
+    custom_tcpdump_put_u32(p, (uint32_t)header->ts.tv_sec);
+    custom_tcpdump_put_u32(p + 4, (uint32_t)header->ts.tv_usec);
+    custom_tcpdump_put_u32(p + 8, caplen);
+    custom_tcpdump_put_u32(p + 12, header->len);
+    memcpy(p + CUSTOM_TCPDUMP_PCAP_RECORD_HEADER_SIZE, packet, caplen);
+    seg->offset += size;
+    r->packets++;
+    r->bytes += caplen;
+    return 0;
+}
+
+// pcap_handler 形式的入口，user 指向 struct custom_tcpdump_rotate
+void custom_tcpdump_rotate_handler(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct custom_tcpdump_rotate *r = (struct custom_tcpdump_rotate *)user;
+
+    if (custom_tcpdump_rotate_append(r, header, packet) != 0 && r->handle != NULL) {
+        pcap_breakloop(r->handle);
+    }
+}
+
+/*
+ * 收尾当前段，等后台线程把所有段落盘后退出。
+ * 所有文件都成功写完返回 0，否则返回 -1。
+ */
+int custom_tcpdump_rotate_close(struct custom_tcpdump_rotate *r) {
+    pthread_mutex_lock(&r->lock);
+    if (r->current != NULL) {
+        r->current->next = NULL;
+        if (r->retire_tail != NULL) {
+            r->retire_tail->next = r->current;
+        } else {
+            r->retire_head = r->current;
+        }
+        r->retire_tail = r->current;
+        r->current = NULL;
+    }
+    r->stopping = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    pthread_join(r->thread, NULL);
+    // 后台线程提前退出时可能还有没收尾的段
+    while (r->retire_head != NULL) {
+        struct custom_tcpdump_segment *seg = r->retire_head;
+
+        r->retire_head = seg->next;
+        if (custom_tcpdump_segment_close(seg) != 0) {
+            custom_tcpdump_rotate_set_error(r);
+        }
+    }
+    r->retire_tail = NULL;
+    pthread_cond_destroy(&r->spare_cond);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    return custom_tcpdump_rotate_failed(r) ? -1 : 0;
+}
+
+struct custom_tcpdump_rotate_ctx {
+    struct custom_tcpdump_rotate *sink;
+    pcap_t *handle;
+    struct custom_tcpdump_stats *stats;
+};
+
+static void custom_tcpdump_rotate_cb(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct custom_tcpdump_rotate_ctx *ctx = (struct custom_tcpdump_rotate_ctx *)user;
+
+    if (custom_tcpdump_rotate_append(ctx->sink, header, packet) != 0) {
+        custom_tcpdump_stop(ctx->handle, ctx->stats, CUSTOM_TCPDUMP_STOP_WRITE_ERROR);
+    }
+}
+
+/*
+ * 批量引擎加滚动文件输出：按 opts 的停止条件抓包，写入 config 描述的一组 pcap 文件。
+ * config 的 linktype 和 snaplen 会按打开的句柄修正。session 可以为 NULL。
+ * 写盘出错（包括后台线程收尾失败）时停止抓包，stats->stop_reason 为
+ * CUSTOM_TCPDUMP_STOP_WRITE_ERROR，返回 -6；其余错误码与 custom_tcpdump_run 一致。
+ */
+int custom_tcpdump_capture_rotating(const char* iface, const char* custom_filter, const struct custom_tcpdump_options *opts,
+                                    struct custom_tcpdump_session *session, const struct custom_tcpdump_rotate_config *config,
+                                    struct custom_tcpdump_stats *stats) {
+    static const struct custom_tcpdump_rotate_config default_config = CUSTOM_TCPDUMP_ROTATE_CONFIG_DEFAULT;
+    struct custom_tcpdump_rotate_config cfg = config != NULL ? *config : default_config;
+    struct custom_tcpdump_rotate sink;
+    struct custom_tcpdump_rotate_ctx ctx;
+    pcap_t *handle;
+    int ret;
+
+    if ((ret = custom_tcpdump_open_ex(iface, custom_filter, opts, &handle)) != 0) {
+        return ret;
+    }
+    cfg.linktype = pcap_datalink(handle);
+    cfg.snaplen = pcap_snapshot(handle);
+    if (custom_tcpdump_rotate_open(&sink, &cfg) != 0) {
+        pcap_close(handle);
+        return -6;
+    }
+    ctx.sink = &sink;
+    ctx.handle = handle;
+    ctx.stats = stats;
+    ret = custom_tcpdump_run_handle(handle, opts, session, custom_tcpdump_rotate_cb, (u_char *)&ctx, stats);
+    if (custom_tcpdump_rotate_close(&sink) != 0 && ret == 0) {
+        ret = -6;
+    }
+    pcap_close(handle);
+    return ret;
+}
+
+#endif // CUSTOM_TCPDUMP_ROTATE_H
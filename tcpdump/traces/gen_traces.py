@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+生成 custom_tcpdump_bench_main 使用的样例抓包文件，输出到本脚本所在目录。
+
+随机数种子固定，重复运行得到完全相同的文件；提交的 .pcap 就是用它生成的，
+修改流量构成后重新运行并一起提交，基准数据需要随之重新记录。
+
+  udp_small.pcap      2000 个 64 字节的 UDP 包，多个端口（DNS、NTP、随机端口）
+  imix.pcap           1500 个 IPv4 包，TCP/UDP/ICMP 混合，长度按 IMIX 7:4:1 分布
+  v6_vlan_mixed.pcap  1000 个包：IPv6 TCP/UDP、802.1Q VLAN 里的 IPv4、ARP
+"""
+
+import os
+import random
+import struct
+
+LINKTYPE_ETHERNET = 1
+SNAPLEN = 65535
+
+MAC_A = bytes.fromhex("020000000001")
+MAC_B = bytes.fromhex("020000000002")
+
+
+def csum(data):
+    if len(data) % 2:
+        data += b"\0"
+    s = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    while s >> 16:
+        s = (s & 0xFFFF) + (s >> 16)
+    return ~s & 0xFFFF
+
+
+def eth(ethertype, payload, vlan=None):
+    hdr = MAC_B + MAC_A
+    if vlan is not None:
+        hdr += struct.pack("!HH", 0x8100, vlan)
+    frame = hdr + struct.pack("!H", ethertype) + payload
+    # 以太网最短 60 字节（不含 FCS）
+    return frame + b"\0" * max(0, 60 - len(frame))
+
+
+def ipv4(src, dst, proto, payload, ident):
+    hdr = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(payload), ident, 0x4000, 64, proto, 0,
+                      bytes(src), bytes(dst))
+    hdr = hdr[:10] + struct.pack("!H", csum(hdr)) + hdr[12:]
+    return hdr + payload
+
+
+def ipv6(src, dst, nh, payload):
+    return struct.pack("!IHBB16s16s", 6 << 28, len(payload), nh, 64, bytes(src), bytes(dst)) + payload
+
+
+def udp(sport, dport, payload):
+    return struct.pack("!HHHH", sport, dport, 8 + len(payload), 0) + payload
+
+
+def tcp(sport, dport, seq, flags, payload):
+    return struct.pack("!HHIIBBHHH", sport, dport, seq, 0, 5 << 4, flags, 65535, 0, 0) + payload
+
+
+def icmp_echo(ident, seq, payload):
+    hdr = struct.pack("!BBHHH", 8, 0, 0, ident, seq) + payload
+    return hdr[:2] + struct.pack("!H", csum(hdr)) + hdr[4:]
+
+
+def arp(sender_ip, target_ip):
+    return struct.pack("!HHBBH6s4s6s4s", 1, 0x0800, 6, 4, 1, MAC_A, bytes(sender_ip), b"\0" * 6, bytes(target_ip))
+
+
+def fill(rng, n):
+    return bytes(rng.getrandbits(8) for _ in range(n)) if n > 0 else b""
+
+
+def host4(rng):
+    return [10, 0, rng.randrange(4), rng.randrange(1, 16)]
+
+
+def host6(rng):
+    return [0x20, 0x01, 0x0d, 0xb8] + [0] * 10 + [rng.randrange(4), rng.randrange(1, 16)]
+
+
+def write_pcap(path, frames, rng):
+    ts = 1700000000.0
+    with open(path, "wb") as f:
+        f.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, SNAPLEN, LINKTYPE_ETHERNET))
+        for frame in frames:
+            # 包间隔 5us 到 1ms，回放时可以按原始节奏检查
+            ts += rng.uniform(5e-6, 1e-3)
+            sec = int(ts)
+            usec = int(round((ts - sec) * 1e6))
+            if usec == 1000000:
+                sec, usec = sec + 1, 0
+            f.write(struct.pack("<IIII", sec, usec, len(frame), len(frame)))
+            f.write(frame)
+
+
+def udp_small(rng):
+    frames = []
+    for i in range(2000):
+        dport = rng.choice([53, 53, 123, rng.randrange(1024, 65536)])
+        # 14 + 20 + 8 + 22 = 64 字节
+        frames.append(eth(0x0800, ipv4(host4(rng), host4(rng), 17,
+                                       udp(rng.randrange(1024, 65536), dport, fill(rng, 22)), i)))
+    return frames
+
+
+def l4_v4(rng, i, size):
+    src, dst = host4(rng), host4(rng)
+    kind = rng.choices(["tcp", "udp", "icmp"], [6, 3, 1])[0]
+    if kind == "tcp":
+        body = fill(rng, size - 14 - 20 - 20)
+        return ipv4(src, dst, 6, tcp(rng.randrange(1024, 65536), rng.choice([80, 443, 22, 8080]),
+                                     rng.getrandbits(32), 0x18, body), i)
+    if kind == "udp":
+        body = fill(rng, size - 14 - 20 - 8)
+        return ipv4(src, dst, 17, udp(rng.randrange(1024, 65536), rng.choice([53, 4789, 5353]), body), i)
+    body = fill(rng, size - 14 - 20 - 8)
+    return ipv4(src, dst, 1, icmp_echo(0x1234, i, body), i)
+
+
+def imix(rng):
+    frames = []
+    for i in range(1500):
+        size = rng.choices([64, 576, 1500], [7, 4, 1])[0]
+        frames.append(eth(0x0800, l4_v4(rng, i, size)))
+    return frames
+
+
+def v6_vlan_mixed(rng):
+    frames = []
+    for i in range(1000):
+        kind = rng.choices(["v6tcp", "v6udp", "vlan", "arp"], [4, 3, 2, 1])[0]
+        if kind == "v6tcp":
+            body = fill(rng, rng.choice([0, 200, 1200]))
+            frames.append(eth(0x86DD, ipv6(host6(rng), host6(rng), 6,
+                                           tcp(rng.randrange(1024, 65536), rng.choice([80, 443]),
+                                               rng.getrandbits(32), 0x18, body))))
+        elif kind == "v6udp":
+            body = fill(rng, rng.choice([20, 100, 500]))
+            frames.append(eth(0x86DD, ipv6(host6(rng), host6(rng), 17,
+                                           udp(rng.randrange(1024, 65536), rng.choice([53, 443]), body))))
+        elif kind == "vlan":
+            size = rng.choice([64, 576])
+            frames.append(eth(0x0800, l4_v4(rng, i, size - 4), vlan=rng.choice([10, 20])))
+        else:
+            frames.append(eth(0x0806, arp(host4(rng), host4(rng))))
+    return frames
+
+
+def main():
+    out = os.path.dirname(os.path.abspath(__file__))
+    for name, gen in (("udp_small", udp_small), ("imix", imix), ("v6_vlan_mixed", v6_vlan_mixed)):
+        rng = random.Random(name)
+        write_pcap(os.path.join(out, name + ".pcap"), gen(rng), rng)
+
+
+if __name__ == "__main__":
+    main()
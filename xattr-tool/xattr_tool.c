@@ -1,18 +1,1183 @@
+#define _XOPEN_SOURCE 700
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <linux/limits.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/xattr.h>
 
 // 打印用法说明
 void print_usage(const char *prog_name)
 {
   fprintf(stderr, "用法: %s <get|set> <文件路径> <属性名> [<属性值> (仅用于 set)]\n", prog_name);
+  fprintf(stderr, "      %s batch <get|set|list> [-r <目录>] [-n <属性名>] [-v <属性值>] [-t <线程数>] [-0] [-j]\n", prog_name);
+  fprintf(stderr, "        -r  遍历目录树（不跟随符号链接）；不指定时从标准输入读取路径，每行一个\n");
+  fprintf(stderr, "        -0  标准输入的路径以 NUL 分隔，可配合 find -print0\n");
+  fprintf(stderr, "        -j  输出 JSON lines，属性值中的不可打印字节会被转义；默认输出以 NUL 分隔的字段\n");
+  fprintf(stderr, "      %s dump [-r <目录>] [-t <线程数>] [-0] > <备份文件>\n", prog_name);
+  fprintf(stderr, "      %s restore [-C <目录>] [-t <线程数>] < <备份文件>\n", prog_name);
+  fprintf(stderr, "        dump 导出每个文件的全部扩展属性，restore 按备份写回（-C 先切换到该目录，用于相对路径）\n");
+}
+
+/*
+ * 批量模式：一个进程处理大量文件，避免每个文件一次 fork/exec。
+ *
+ * 主线程负责产生路径（从标准输入读取，或用 nftw 遍历目录树），放进有界队列；
+ * 工作线程从队列取路径执行 get/set/list，把一个文件的全部结果先写进线程自己的
+ * 输出缓冲区，再加锁一次性写到标准输出，保证不同文件的记录不会交错。
+ *
+ * 每个线程有一块可增长的值缓冲区，先直接用它调用一次 getxattr/listxattr，
+ * 只有返回 ERANGE 时才探测实际长度并扩容，大多数文件只需要一次系统调用。
+ */
+
+#define BATCH_QUEUE_SIZE 1024
+#define BATCH_INITIAL_BUFFER 256
+
+enum batch_op
+{
+  BATCH_GET,
+  BATCH_SET,
+  BATCH_LIST,
+  BATCH_DUMP,
+  BATCH_RESTORE,
+};
+
+struct batch_options
+{
+  enum batch_op op;
+  const char *root;       // 非 NULL 时遍历该目录树
+  const char *attrname;   // get/set 使用
+  const char *attrvalue;  // set 使用
+  const char *chdir_to;   // restore 使用
+  int threads;
+  int nul_input;
+  int json;
+};
+
+// 可增长缓冲区，工作线程各有一个，跨文件复用
+struct batch_buffer
+{
+  char *data;
+  size_t len;
+  size_t cap;
+};
+
+struct batch_queue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  char *paths[BATCH_QUEUE_SIZE];
+  size_t head;
+  size_t count;
+  int closed;
+};
+
+static struct batch_options batch_opts;
+static struct batch_queue batch_queue = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .not_empty = PTHREAD_COND_INITIALIZER,
+  .not_full = PTHREAD_COND_INITIALIZER,
+};
+static pthread_mutex_t batch_output_lock = PTHREAD_MUTEX_INITIALIZER;
+static int batch_failed;
+
+// 保证缓冲区至少还能再放 extra 字节
+static int batch_buffer_reserve(struct batch_buffer *buf, size_t extra)
+{
+  size_t cap = buf->cap ? buf->cap : BATCH_INITIAL_BUFFER;
+  char *data;
+
+  while (cap - buf->len < extra)
+  {
+    cap *= 2;
+  }
+  if (cap == buf->cap)
+  {
+    return 0;
+  }
+  data = realloc(buf->data, cap);
+  if (data == NULL)
+  {
+    return -1;
+  }
+  buf->data = data;
+  buf->cap = cap;
+  return 0;
+}
+
+static int batch_buffer_append(struct batch_buffer *buf, const char *data, size_t len)
+{
+  if (batch_buffer_reserve(buf, len) != 0)
+  {
+    return -1;
+  }
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  return 0;
+}
+
+// 按 JSON 字符串规则转义并加上引号，不可打印字节写成 \u00XX
+static int batch_append_json_string(struct batch_buffer *buf, const char *s, size_t len)
+{
+  static const char hex[] = "0123456789abcdef";
+  char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+  size_t i;
+
+  if (batch_buffer_append(buf, "\"", 1) != 0)
+  {
+    return -1;
+  }
+  for (i = 0; i < len; i++)
+  {
+    unsigned char c = (unsigned char)s[i];
+    int ret;
+
+    if (c == '"' || c == '\\')
+    {
+      char two[2] = { '\\', (char)c };
+      ret = batch_buffer_append(buf, two, 2);
+    }
+    else if (c < 0x20 || c >= 0x7f)
+    {
+      esc[4] = hex[c >> 4];
+      esc[5] = hex[c & 0xf];
+      ret = batch_buffer_append(buf, esc, 6);
+    }
+    else
+    {
+      ret = batch_buffer_append(buf, (const char *)&c, 1);
+    }
+    if (ret != 0)
+    {
+      return -1;
+    }
+  }
+  return batch_buffer_append(buf, "\"", 1);
+}
+
+/*
+ * 追加一条记录。value 为 NULL 表示属性不存在，err 非 0 表示出错。
+ * NUL 格式：路径\0属性名\0属性值\0，list 没有属性值这一项，出错的记录只写到标准错误。
+ * JSON 格式：{"path":...,"name":...,"value":...} 或带 "error" 字段。
+ */
+static int batch_emit(struct batch_buffer *out, const char *path, const char *name,
+                      const char *value, size_t value_len, int err)
+{
+  int ret = 0;
+
+  if (!batch_opts.json)
+  {
+    if (err != 0)
+    {
+      fprintf(stderr, "错误：%s 的扩展属性 \"%s\" 处理失败，原因：%s\n", path, name ? name : "", strerror(err));
+      return 0;
+    }
+    if (value == NULL && batch_opts.op == BATCH_GET)
+    {
+      return 0;
+    }
+    ret |= batch_buffer_append(out, path, strlen(path) + 1);
+    if (name != NULL)
+    {
+      ret |= batch_buffer_append(out, name, strlen(name) + 1);
+    }
+    if (value != NULL)
+    {
+      ret |= batch_buffer_append(out, value, value_len);
+      ret |= batch_buffer_append(out, "", 1);
+    }
+    return ret;
+  }
+
+  ret |= batch_buffer_append(out, "{\"path\":", 8);
+  ret |= batch_append_json_string(out, path, strlen(path));
+  if (name != NULL)
+  {
+    ret |= batch_buffer_append(out, ",\"name\":", 8);
+    ret |= batch_append_json_string(out, name, strlen(name));
+  }
+  if (err != 0)
+  {
+    ret |= batch_buffer_append(out, ",\"error\":", 9);
+    ret |= batch_append_json_string(out, strerror(err), strlen(strerror(err)));
+  }
+  else if (batch_opts.op == BATCH_GET)
+  {
+    ret |= batch_buffer_append(out, ",\"value\":", 9);
+    if (value != NULL)
+    {
+      ret |= batch_append_json_string(out, value, value_len);
+    }
+    else
+    {
+      ret |= batch_buffer_append(out, "null", 4);
+    }
+  }
+  ret |= batch_buffer_append(out, "}\n", 2);
+  return ret;
+}
+
+/*
+ * 一次 xattr 读取调用：fd >= 0 时走 f*xattr，否则按路径；name 为 NULL 时是 list。
+ * 按路径时 nofollow 非 0 用 l*xattr，不跟随符号链接。
+ */
+struct xattr_call
+{
+  int fd;
+  const char *path;
+  const char *name;
+  int nofollow;
+};
+
+static ssize_t xattr_call_do(const struct xattr_call *c, char *dst, size_t size)
+{
+  if (c->fd >= 0)
+  {
+    return c->name ? fgetxattr(c->fd, c->name, dst, size) : flistxattr(c->fd, dst, size);
+  }
+  if (c->nofollow)
+  {
+    return c->name ? lgetxattr(c->path, c->name, dst, size) : llistxattr(c->path, dst, size);
+  }
+  return c->name ? getxattr(c->path, c->name, dst, size) : listxattr(c->path, dst, size);
+}
+
+/*
+ * 用线程缓冲区读取属性值或属性名列表：先直接读一次，ERANGE 时探测长度、扩容再读。
+ * 探测和再读之间属性可能又变长，所以循环直到成功。返回读到的长度，失败返回 -1。
+ */
+static ssize_t batch_read_xattr(const struct xattr_call *c, struct batch_buffer *buf)
+{
+  ssize_t len;
+
+  if (buf->cap == 0 && batch_buffer_reserve(buf, BATCH_INITIAL_BUFFER) != 0)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  for (;;)
+  {
+    len = xattr_call_do(c, buf->data, buf->cap);
+    if (len >= 0 || errno != ERANGE)
+    {
+      return len;
+    }
+    len = xattr_call_do(c, NULL, 0);
+    if (len == -1)
+    {
+      return -1;
+    }
+    buf->len = 0;
+    if (batch_buffer_reserve(buf, (size_t)len + 1) != 0)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+}
+
+static ssize_t batch_getxattr(const char *path, const char *name, struct batch_buffer *buf)
+{
+  struct xattr_call c = { -1, path, name, 0 };
+
+  return batch_read_xattr(&c, buf);
+}
+
+static ssize_t batch_listxattr(const char *path, struct batch_buffer *buf)
+{
+  struct xattr_call c = { -1, path, NULL, 0 };
+
+  return batch_read_xattr(&c, buf);
+}
+
+/*
+ * dump/restore 的二进制流格式（本机字节序）：
+ *
+ *   头部:      "XATD" u32 版本号
+ *   属性名定义: 'N' u16 长度 名字        第 k 个定义的名字编号为 k
+ *   文件:      'F' u32 路径长度 路径 u32 属性个数 { u32 名字编号 u32 值长度 值 } ...
+ *   结束:      'E'
+ *
+ * 大量文件通常只用到少数几个属性名，名字只在第一次出现时写一次，之后用编号引用。
+ * 属性名定义总是出现在引用它的文件记录之前，读的时候顺序处理即可。
+ */
+
+#define DUMP_MAGIC "XATD"
+#define DUMP_VERSION 1
+
+// dump 时的名字表，开放寻址，名字到编号
+struct dump_names
+{
+  char **keys;
+  uint32_t *ids;
+  size_t cap;
+  size_t count;
+};
+
+static struct dump_names dump_names;
+
+static uint32_t dump_hash(const char *s)
+{
+  uint32_t h = 2166136261u;
+
+  while (*s)
+  {
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  }
+  return h;
+}
+
+/*
+ * 查找名字的编号，新名字分配编号并写出定义记录。调用者持有输出锁。
+ * 内存不足返回 -1。
+ */
+static int64_t dump_name_id(const char *name, FILE *fp)
+{
+  struct dump_names *t = &dump_names;
+  size_t i, len;
+  uint16_t len16;
+
+  if (t->count * 2 >= t->cap)
+  {
+    size_t cap = t->cap ? t->cap * 2 : 64;
+    char **keys = calloc(cap, sizeof(*keys));
+    uint32_t *ids = calloc(cap, sizeof(*ids));
+
+    if (keys == NULL || ids == NULL)
+    {
+      free(keys);
+      free(ids);
+      return -1;
+    }
+    for (i = 0; i < t->cap; i++)
+    {
+      if (t->keys[i] != NULL)
+      {
+        size_t j = dump_hash(t->keys[i]) & (cap - 1);
+
+        while (keys[j] != NULL)
+        {
+          j = (j + 1) & (cap - 1);
+        }
+        keys[j] = t->keys[i];
+        ids[j] = t->ids[i];
+      }
+    }
+    free(t->keys);
+    free(t->ids);
+    t->keys = keys;
+    t->ids = ids;
+    t->cap = cap;
+  }
+
+  for (i = dump_hash(name) & (t->cap - 1); t->keys[i] != NULL; i = (i + 1) & (t->cap - 1))
+  {
+    if (strcmp(t->keys[i], name) == 0)
+    {
+      return t->ids[i];
+    }
+  }
+
+  if ((t->keys[i] = strdup(name)) == NULL)
+  {
+    return -1;
+  }
+  t->ids[i] = (uint32_t)t->count++;
+  len = strlen(name);
+  len16 = (uint16_t)len;
+  fputc('N', fp);
+  fwrite(&len16, sizeof(len16), 1, fp);
+  fwrite(name, 1, len, fp);
+  return t->ids[i];
+}
+
+/*
+ * dump/restore 用：普通文件和目录打开后返回 fd，之后的 xattr 调用都走 fd；
+ * 设备、FIFO、套接字和符号链接不能打开（打开设备可能有副作用），返回 -2，
+ * 调用者改用 l*xattr 按路径操作。出错返回 -1。
+ */
+static int xattr_open_target(const char *path)
+{
+  struct stat st, fst;
+  int fd;
+
+  if (lstat(path, &st) == -1)
+  {
+    return -1;
+  }
+  if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
+  {
+    return -2;
+  }
+  // O_NONBLOCK：lstat 之后路径被换成 FIFO 时也不会阻塞
+  fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC |
+                  (S_ISDIR(st.st_mode) ? O_DIRECTORY : 0));
+  if (fd == -1)
+  {
+    return -1;
+  }
+  if (fstat(fd, &fst) == -1 || fst.st_dev != st.st_dev || fst.st_ino != st.st_ino)
+  {
+    close(fd);
+    errno = EAGAIN;   // 检查和打开之间文件被替换
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * 读出一个文件的全部属性，暂存到 out：
+ *   u32 路径长度 路径 u32 属性个数 { u32 名字长度 名字 u32 值长度 值 } ...
+ * 名字到编号的转换要在输出锁内做，见 dump_flush。没有属性的文件不输出。
+ */
+static void dump_file(const char *path, struct batch_buffer *names, struct batch_buffer *value,
+                      struct batch_buffer *out)
+{
+  struct xattr_call c;
+  ssize_t names_len, len;
+  const char *name;
+  uint32_t count = 0, n;
+  size_t count_off;
+  int fd, ret = 0;
+
+  fd = xattr_open_target(path);
+  if (fd == -1)
+  {
+    fprintf(stderr, "错误：无法打开 %s，原因：%s\n", path, strerror(errno));
+    __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  c.fd = fd;
+  c.path = path;
+  c.name = NULL;
+  c.nofollow = 1;
+  if ((names_len = batch_read_xattr(&c, names)) <= 0)
+  {
+    if (names_len == -1)
+    {
+      fprintf(stderr, "错误：无法列出 %s 的扩展属性，原因：%s\n", path, strerror(errno));
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    }
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return;
+  }
+
+  n = (uint32_t)strlen(path);
+  ret |= batch_buffer_append(out, (const char *)&n, sizeof(n));
+  ret |= batch_buffer_append(out, path, n);
+  count_off = out->len;
+  ret |= batch_buffer_append(out, (const char *)&count, sizeof(count));
+
+  for (name = names->data; name < names->data + names_len; name += strlen(name) + 1)
+  {
+    c.name = name;
+    len = batch_read_xattr(&c, value);
+    if (len == -1)
+    {
+      // 列出之后被删除的属性直接跳过
+      if (errno != ENODATA)
+      {
+        fprintf(stderr, "错误：无法读取 %s 的扩展属性 \"%s\"，原因：%s\n", path, name, strerror(errno));
+        __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+      }
+      continue;
+    }
+    n = (uint32_t)strlen(name);
+    ret |= batch_buffer_append(out, (const char *)&n, sizeof(n));
+    ret |= batch_buffer_append(out, name, n);
+    n = (uint32_t)len;
+    ret |= batch_buffer_append(out, (const char *)&n, sizeof(n));
+    ret |= batch_buffer_append(out, value->data, (size_t)len);
+    count++;
+  }
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+
+  if (ret != 0)
+  {
+    fprintf(stderr, "错误：内存不足，无法导出 %s\n", path);
+    __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    out->len = 0;
+    return;
+  }
+  if (count == 0)
+  {
+    out->len = 0;
+    return;
+  }
+  memcpy(out->data + count_off, &count, sizeof(count));
+}
+
+// 把 dump_file 暂存的记录转换成流格式写出。调用者持有输出锁
+static void dump_flush(const struct batch_buffer *out, FILE *fp)
+{
+  const char *p = out->data;
+  uint32_t path_len, count, name_len, value_len, i;
+  int64_t id;
+  uint32_t id32;
+  char name[XATTR_NAME_MAX + 1];
+
+  memcpy(&path_len, p, sizeof(path_len));
+  memcpy(&count, p + sizeof(path_len) + path_len, sizeof(count));
+
+  // 先确保所有名字都有编号，新名字的定义记录要写在文件记录之前
+  p += sizeof(path_len) + path_len + sizeof(count);
+  for (i = 0; i < count; i++)
+  {
+    memcpy(&name_len, p, sizeof(name_len));
+    memcpy(name, p + sizeof(name_len), name_len);
+    name[name_len] = '\0';
+    p += sizeof(name_len) + name_len;
+    memcpy(&value_len, p, sizeof(value_len));
+    p += sizeof(value_len) + value_len;
+    if (dump_name_id(name, fp) == -1)
+    {
+      fprintf(stderr, "错误：内存不足，无法分配缓冲区\n");
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  p = out->data;
+  fputc('F', fp);
+  fwrite(p, 1, sizeof(path_len) + path_len + sizeof(count), fp);
+  p += sizeof(path_len) + path_len + sizeof(count);
+  for (i = 0; i < count; i++)
+  {
+    memcpy(&name_len, p, sizeof(name_len));
+    memcpy(name, p + sizeof(name_len), name_len);
+    name[name_len] = '\0';
+    p += sizeof(name_len) + name_len;
+    memcpy(&value_len, p, sizeof(value_len));
+    id = dump_name_id(name, fp);
+    id32 = (uint32_t)id;
+    fwrite(&id32, sizeof(id32), 1, fp);
+    fwrite(p, 1, sizeof(value_len) + value_len, fp);
+    p += sizeof(value_len) + value_len;
+  }
+}
+
+/*
+ * restore 的工作单元由主线程在读流时组装好，名字已经解析成字符串：
+ *   u32 属性个数 路径\0 { 名字\0 u32 值长度 值 } ...
+ */
+static void restore_file(const char *item)
+{
+  const char *path, *name, *p;
+  uint32_t count, value_len, i;
+  int fd;
+
+  memcpy(&count, item, sizeof(count));
+  path = item + sizeof(count);
+  p = path + strlen(path) + 1;
+
+  fd = xattr_open_target(path);
+  if (fd == -1)
+  {
+    fprintf(stderr, "错误：无法打开 %s，原因：%s\n", path, strerror(errno));
+    __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  for (i = 0; i < count; i++)
+  {
+    name = p;
+    p += strlen(name) + 1;
+    memcpy(&value_len, p, sizeof(value_len));
+    p += sizeof(value_len);
+    if ((fd >= 0 ? fsetxattr(fd, name, p, value_len, 0) : lsetxattr(path, name, p, value_len, 0)) == -1)
+    {
+      fprintf(stderr, "错误：无法设置 %s 的扩展属性 \"%s\"，原因：%s\n", path, name, strerror(errno));
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    }
+    p += value_len;
+  }
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+}
+
+// 处理一个文件，结果追加到 out
+static void batch_process(const char *path, struct batch_buffer *names, struct batch_buffer *value,
+                          struct batch_buffer *out)
+{
+  ssize_t len;
+  const char *name;
+  int ret = 0;
+
+  switch (batch_opts.op)
+  {
+  case BATCH_GET:
+    len = batch_getxattr(path, batch_opts.attrname, value);
+    if (len >= 0)
+    {
+      ret = batch_emit(out, path, batch_opts.attrname, value->data, (size_t)len, 0);
+    }
+    else if (errno == ENODATA)
+    {
+      ret = batch_emit(out, path, batch_opts.attrname, NULL, 0, 0);
+    }
+    else
+    {
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+      ret = batch_emit(out, path, batch_opts.attrname, NULL, 0, errno);
+    }
+    break;
+  case BATCH_SET:
+    if (setxattr(path, batch_opts.attrname, batch_opts.attrvalue, strlen(batch_opts.attrvalue), 0) == -1)
+    {
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+      ret = batch_emit(out, path, batch_opts.attrname, NULL, 0, errno);
+    }
+    else
+    {
+      ret = batch_emit(out, path, batch_opts.attrname, NULL, 0, 0);
+    }
+    break;
+  case BATCH_LIST:
+    len = batch_listxattr(path, value);
+    if (len == -1)
+    {
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+      ret = batch_emit(out, path, NULL, NULL, 0, errno);
+      break;
+    }
+    // 属性名列表是一串以 NUL 结尾的字符串
+    for (name = value->data; name < value->data + len; name += strlen(name) + 1)
+    {
+      ret |= batch_emit(out, path, name, NULL, 0, 0);
+    }
+    break;
+  case BATCH_DUMP:
+    dump_file(path, names, value, out);
+    break;
+  case BATCH_RESTORE:
+    restore_file(path);
+    break;
+  }
+  if (ret != 0)
+  {
+    fprintf(stderr, "错误：内存不足，无法输出 %s 的结果\n", path);
+    __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// 入队，队列满时阻塞。path 的所有权交给队列
+static void batch_queue_push(char *path)
+{
+  struct batch_queue *q = &batch_queue;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == BATCH_QUEUE_SIZE)
+  {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  q->paths[(q->head + q->count) % BATCH_QUEUE_SIZE] = path;
+  q->count++;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+// 出队，队列已关闭且为空时返回 NULL
+static char *batch_queue_pop(void)
+{
+  struct batch_queue *q = &batch_queue;
+  char *path = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed)
+  {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  if (q->count > 0)
+  {
+    path = q->paths[q->head];
+    q->head = (q->head + 1) % BATCH_QUEUE_SIZE;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return path;
+}
+
+static void batch_queue_close(void)
+{
+  pthread_mutex_lock(&batch_queue.lock);
+  batch_queue.closed = 1;
+  pthread_cond_broadcast(&batch_queue.not_empty);
+  pthread_mutex_unlock(&batch_queue.lock);
+}
+
+static void *batch_worker(void *arg)
+{
+  struct batch_buffer names = { 0 };
+  struct batch_buffer value = { 0 };
+  struct batch_buffer out = { 0 };
+  char *path;
+
+  (void)arg;
+  while ((path = batch_queue_pop()) != NULL)
+  {
+    out.len = 0;
+    batch_process(path, &names, &value, &out);
+    free(path);
+    if (out.len > 0)
+    {
+      pthread_mutex_lock(&batch_output_lock);
+      if (batch_opts.op == BATCH_DUMP)
+      {
+        dump_flush(&out, stdout);
+      }
+      else
+      {
+        fwrite(out.data, 1, out.len, stdout);
+      }
+      pthread_mutex_unlock(&batch_output_lock);
+    }
+  }
+  free(names.data);
+  free(value.data);
+  free(out.data);
+  return NULL;
+}
+
+// nftw 回调，只处理普通文件和目录，符号链接不跟随也不处理
+static int batch_walk_cb(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf)
+{
+  char *copy;
+
+  (void)sb;
+  (void)ftwbuf;
+  if (typeflag == FTW_DNR || typeflag == FTW_NS)
+  {
+    fprintf(stderr, "错误：无法访问 %s\n", path);
+    __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  if (typeflag != FTW_F && typeflag != FTW_D)
+  {
+    return 0;
+  }
+  if ((copy = strdup(path)) == NULL)
+  {
+    fprintf(stderr, "错误：内存不足，无法分配缓冲区\n");
+    return -1;
+  }
+  batch_queue_push(copy);
+  return 0;
+}
+
+// 从标准输入读取路径，按换行或 NUL 分隔
+static int batch_read_paths(void)
+{
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  int delim = batch_opts.nul_input ? '\0' : '\n';
+
+  while ((len = getdelim(&line, &cap, delim, stdin)) != -1)
+  {
+    if (len > 0 && line[len - 1] == delim)
+    {
+      line[--len] = '\0';
+    }
+    if (len == 0)
+    {
+      continue;
+    }
+    batch_queue_push(line);
+    line = NULL;
+    cap = 0;
+  }
+  free(line);
+  return 0;
+}
+
+static int restore_read(void *dst, size_t len)
+{
+  if (fread(dst, 1, len, stdin) != len)
+  {
+    fprintf(stderr, "错误：备份数据不完整\n");
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * 与 tar 一样处理备份里的路径，保证写回不会跑到 -C 目录之外：
+ * 去掉开头的 '/'（只提示一次，去掉后为空时当作 "."），含 ".." 路径分量的返回 -1。
+ */
+static int restore_check_path(char *path)
+{
+  static int warned;
+  const char *p;
+  size_t skip = strspn(path, "/");
+
+  if (skip > 0)
+  {
+    if (!warned)
+    {
+      fprintf(stderr, "提示：去掉路径开头的 \"/\"\n");
+      warned = 1;
+    }
+    memmove(path, path + skip, strlen(path + skip) + 1);
+    if (path[0] == '\0')
+    {
+      strcpy(path, ".");
+    }
+  }
+  for (p = path; *p != '\0'; p += strcspn(p, "/"), p += strspn(p, "/"))
+  {
+    if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0'))
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * 主线程顺序解析标准输入上的备份流，把每个文件组装成工作单元交给线程池。
+ * 路径、名字和值的长度超出内核限制都算格式错误；含 ".." 的路径跳过并报错。
+ * 成功返回 0，格式错误或数据截断返回 -1。
+ */
+static int restore_stream(void)
+{
+  char header[8];
+  char **names = NULL;
+  size_t nr_names = 0, cap_names = 0;
+  struct batch_buffer item = { 0 };
+  uint32_t version, path_len, count, id, value_len, i;
+  uint16_t name_len;
+  int tag, skip, ret = -1;
+  char *copy, *path;
+
+  if (restore_read(header, sizeof(header)) != 0)
+  {
+    return -1;
+  }
+  memcpy(&version, header + 4, sizeof(version));
+  if (memcmp(header, DUMP_MAGIC, 4) != 0 || version != DUMP_VERSION)
+  {
+    fprintf(stderr, "错误：不是本工具生成的备份文件\n");
+    return -1;
+  }
+
+  while ((tag = fgetc(stdin)) != EOF)
+  {
+    if (tag == 'E')
+    {
+      ret = 0;
+      break;
+    }
+    if (tag == 'N')
+    {
+      if (restore_read(&name_len, sizeof(name_len)) != 0)
+      {
+        goto out;
+      }
+      if (name_len == 0 || name_len > XATTR_NAME_MAX)
+      {
+        fprintf(stderr, "错误：备份数据格式错误\n");
+        goto out;
+      }
+      if (nr_names == cap_names)
+      {
+        char **grown = realloc(names, (cap_names ? cap_names * 2 : 64) * sizeof(*names));
+
+        if (grown == NULL)
+        {
+          goto nomem;
+        }
+        names = grown;
+        cap_names = cap_names ? cap_names * 2 : 64;
+      }
+      if ((names[nr_names] = malloc((size_t)name_len + 1)) == NULL)
+      {
+        goto nomem;
+      }
+      if (restore_read(names[nr_names], name_len) != 0)
+      {
+        free(names[nr_names]);
+        goto out;
+      }
+      if (memchr(names[nr_names], '\0', name_len) != NULL)
+      {
+        free(names[nr_names]);
+        fprintf(stderr, "错误：备份数据格式错误\n");
+        goto out;
+      }
+      names[nr_names++][name_len] = '\0';
+      continue;
+    }
+    if (tag != 'F')
+    {
+      fprintf(stderr, "错误：备份数据格式错误\n");
+      goto out;
+    }
+
+    // 组装工作单元：属性个数、路径、各属性的名字和值
+    item.len = 0;
+    if (restore_read(&path_len, sizeof(path_len)) != 0)
+    {
+      goto out;
+    }
+    if (path_len == 0 || path_len >= PATH_MAX)
+    {
+      fprintf(stderr, "错误：备份数据格式错误\n");
+      goto out;
+    }
+    if (batch_buffer_reserve(&item, sizeof(count) + (size_t)path_len + 1) != 0)
+    {
+      goto nomem;
+    }
+    item.len = sizeof(count);
+    path = item.data + item.len;
+    if (restore_read(path, path_len) != 0 || restore_read(&count, sizeof(count)) != 0)
+    {
+      goto out;
+    }
+    if (memchr(path, '\0', path_len) != NULL)
+    {
+      fprintf(stderr, "错误：备份数据格式错误\n");
+      goto out;
+    }
+    path[path_len] = '\0';
+    // 有问题的路径仍要读完它的属性，流才能接着往下解析
+    if ((skip = restore_check_path(path)) != 0)
+    {
+      fprintf(stderr, "错误：跳过含 \"..\" 的路径 %s\n", path);
+      __atomic_store_n(&batch_failed, 1, __ATOMIC_RELAXED);
+    }
+    item.len += strlen(path) + 1;
+    memcpy(item.data, &count, sizeof(count));
+    for (i = 0; i < count; i++)
+    {
+      if (restore_read(&id, sizeof(id)) != 0 || restore_read(&value_len, sizeof(value_len)) != 0)
+      {
+        goto out;
+      }
+      if (id >= nr_names || value_len > XATTR_SIZE_MAX)
+      {
+        fprintf(stderr, "错误：备份数据格式错误\n");
+        goto out;
+      }
+      if (batch_buffer_append(&item, names[id], strlen(names[id]) + 1) != 0 ||
+          batch_buffer_append(&item, (const char *)&value_len, sizeof(value_len)) != 0 ||
+          batch_buffer_reserve(&item, value_len) != 0)
+      {
+        goto nomem;
+      }
+      if (restore_read(item.data + item.len, value_len) != 0)
+      {
+        goto out;
+      }
+      item.len += value_len;
+    }
+    if (skip)
+    {
+      continue;
+    }
+    if ((copy = malloc(item.len)) == NULL)
+    {
+      goto nomem;
+    }
+    memcpy(copy, item.data, item.len);
+    batch_queue_push(copy);
+  }
+  if (ret != 0)
+  {
+    fprintf(stderr, "错误：备份数据不完整\n");
+  }
+  goto out;
+
+nomem:
+  fprintf(stderr, "错误：内存不足，无法分配缓冲区\n");
+out:
+  while (nr_names > 0)
+  {
+    free(names[--nr_names]);
+  }
+  free(names);
+  free(item.data);
+  return ret;
+}
+
+int batch_main(int argc, char *argv[], const char *prog_name)
+{
+  pthread_t *threads;
+  long ncpu;
+  int opt, i, ret;
+
+  if (argc < 2)
+  {
+    print_usage(prog_name);
+    return 1;
+  }
+  if (strcmp(argv[1], "get") == 0)
+  {
+    batch_opts.op = BATCH_GET;
+  }
+  else if (strcmp(argv[1], "set") == 0)
+  {
+    batch_opts.op = BATCH_SET;
+  }
+  else if (strcmp(argv[1], "list") == 0)
+  {
+    batch_opts.op = BATCH_LIST;
+  }
+  else if (strcmp(argv[1], "dump") == 0)
+  {
+    batch_opts.op = BATCH_DUMP;
+  }
+  else if (strcmp(argv[1], "restore") == 0)
+  {
+    batch_opts.op = BATCH_RESTORE;
+  }
+  else
+  {
+    print_usage(prog_name);
+    return 1;
+  }
+
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  batch_opts.threads = ncpu > 0 ? (int)ncpu : 4;
+  optind = 2;
+  while ((opt = getopt(argc, argv, "r:n:v:t:0jC:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'C':
+      batch_opts.chdir_to = optarg;
+      break;
+    case 'r':
+      batch_opts.root = optarg;
+      break;
+    case 'n':
+      batch_opts.attrname = optarg;
+      break;
+    case 'v':
+      batch_opts.attrvalue = optarg;
+      break;
+    case 't':
+      batch_opts.threads = atoi(optarg);
+      break;
+    case '0':
+      batch_opts.nul_input = 1;
+      break;
+    case 'j':
+      batch_opts.json = 1;
+      break;
+    default:
+      print_usage(prog_name);
+      return 1;
+    }
+  }
+  if (batch_opts.threads < 1 ||
+      ((batch_opts.op == BATCH_GET || batch_opts.op == BATCH_SET) && batch_opts.attrname == NULL) ||
+      (batch_opts.op == BATCH_SET && batch_opts.attrvalue == NULL) ||
+      (batch_opts.op == BATCH_RESTORE && batch_opts.root != NULL))
+  {
+    print_usage(prog_name);
+    return 1;
+  }
+  if (batch_opts.chdir_to != NULL && chdir(batch_opts.chdir_to) == -1)
+  {
+    fprintf(stderr, "错误：无法切换到目录 %s，原因：%s\n", batch_opts.chdir_to, strerror(errno));
+    return 1;
+  }
+  if (batch_opts.op == BATCH_DUMP)
+  {
+    uint32_t version = DUMP_VERSION;
+
+    fwrite(DUMP_MAGIC, 1, 4, stdout);
+    fwrite(&version, sizeof(version), 1, stdout);
+  }
+
+  threads = calloc((size_t)batch_opts.threads, sizeof(*threads));
+  if (threads == NULL)
+  {
+    fprintf(stderr, "错误：内存不足，无法分配缓冲区\n");
+    return 1;
+  }
+  for (i = 0; i < batch_opts.threads; i++)
+  {
+    if ((ret = pthread_create(&threads[i], NULL, batch_worker, NULL)) != 0)
+    {
+      fprintf(stderr, "错误：无法创建工作线程，原因：%s\n", strerror(ret));
+      batch_opts.threads = i;
+      batch_failed = 1;
+      break;
+    }
+  }
+
+  if (batch_opts.threads > 0)
+  {
+    if (batch_opts.op == BATCH_RESTORE)
+    {
+      if (restore_stream() != 0)
+      {
+        batch_failed = 1;
+      }
+    }
+    else if (batch_opts.root != NULL)
+    {
+      if (nftw(batch_opts.root, batch_walk_cb, 64, FTW_PHYS) == -1)
+      {
+        fprintf(stderr, "错误：遍历目录 %s 失败，原因：%s\n", batch_opts.root, strerror(errno));
+        batch_failed = 1;
+      }
+    }
+    else
+    {
+      batch_read_paths();
+    }
+  }
+
+  batch_queue_close();
+  for (i = 0; i < batch_opts.threads; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  if (batch_opts.op == BATCH_DUMP)
+  {
+    fputc('E', stdout);
+  }
+  if (fflush(stdout) == EOF)
+  {
+    fprintf(stderr, "错误：写出结果失败，原因：%s\n", strerror(errno));
+    batch_failed = 1;
+  }
+  return batch_failed ? 1 : 0;
 }
 
 int main(int argc, char *argv[])
 {
+  // 批量模式有自己的参数格式
+  if (argc >= 2 && strcmp(argv[1], "batch") == 0)
+  {
+    return batch_main(argc - 1, argv + 1, argv[0]);
+  }
+  // dump/restore 复用批量模式的线程池
+  if (argc >= 2 && (strcmp(argv[1], "dump") == 0 || strcmp(argv[1], "restore") == 0))
+  {
+    return batch_main(argc, argv, argv[0]);
+  }
+
   // 检查参数数量
   if (argc < 4)
   {